@@ -0,0 +1,99 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+#include "FileHashCache.hpp"
+
+#include <WIR/Stream.hpp>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/** What an input header was last generated from */
+struct ManifestEntry
+{
+  std::string outputFile;
+  uint64_t flagsHash = 0;
+
+  // The header itself followed by every file its translation unit read
+  std::vector<std::string> dependencies;
+
+  // Files the header includes itself, used to pick the precompiled preamble
+  std::vector<std::string> directIncludes;
+
+  // Content hash of the precompiled preamble the header was parsed on top of, 0 without one. Stands in for every file
+  // the preamble read, none of which are among the dependencies.
+  uint64_t preambleHash = 0;
+};
+
+/** The headers found by walking an input directory, and every directory the walk went through */
+struct InputTree
+{
+  std::string rootPath;
+
+  // Modification time of each directory when it was walked, 0 for one that changed too recently to be trusted
+  std::map<std::string, uint64_t> directories;
+
+  std::vector<std::string> headers;
+};
+
+/**
+ * Persistent record of every generated header, its output and its full input set.
+ * A header is stale when its output is missing, the flag set changed, or the contents of any file it
+ * depends on changed.
+ */
+class BuildManifest : public wir::Serializable
+{
+public:
+  bool load(std::string const &path);
+  bool save(std::string const &path) const;
+
+  /** Hash of everything besides file contents that affects a parse */
+  static uint64_t computeFlagsHash(std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options);
+
+  /** The preamble hash is that of the last preamble if nothing it read has changed since, 0 otherwise */
+  bool isStale(std::string const &inputFile, std::string const &outputFile, uint64_t flagsHash, uint64_t preambleHash, FileHashCache &hashes) const;
+
+  /** Records a successful generation, dependencies should include the input file itself */
+  void update(std::string const &inputFile, std::string const &outputFile, uint64_t flagsHash, std::vector<std::string> const &dependencies, std::vector<std::string> const &directIncludes, uint64_t preambleHash, FileHashCache &hashes);
+
+  void remove(std::string const &inputFile);
+
+  /** Drops entries for inputs that no longer exist, and file records nothing refers to. Returns whether any were dropped. */
+  bool prune(std::set<std::string> const &existingInputs);
+
+  /**
+   * The headers the last walk of a directory found, as long as no directory under it has changed since. Costs a stat
+   * per directory instead of a walk of the tree.
+   */
+  bool getInputHeaders(std::string const &rootPath, std::vector<std::string> &outHeaders) const;
+
+  void setInputTree(InputTree const &tree);
+
+  ManifestEntry const *findEntry(std::string const &inputFile) const;
+
+  /** Records how long generating a header took, in microseconds */
+  void setGenerateCost(std::string const &inputFile, uint64_t microseconds);
+
+  /** Looks up how long generating a header took last time it was parsed, returns false if unknown */
+  bool getGenerateCost(std::string const &inputFile, uint64_t &outMicroseconds) const;
+
+  inline std::map<std::string, FileRecord> const &getFileRecords() const
+  {
+    return m_files;
+  }
+
+  virtual bool serialize(wir::Stream &toStream) const override;
+  virtual bool deserialize(wir::Stream &fromStream) override;
+
+protected:
+  std::map<std::string, ManifestEntry> m_entries;
+  std::map<std::string, FileRecord> m_files;
+
+  // Kept apart from the entries, a header that failed still has a meaningful cost
+  std::map<std::string, uint64_t> m_generateCosts;
+
+  InputTree m_inputTree;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** What came out of generating one header */
+struct GeneratedSource
+{
+  std::string headerPath;
+
+  // Empty if the header declares no reflected classes, or failed to parse
+  std::string source;
+
+  bool valid = false;
+  std::vector<HeaderMessage> messages;
+
+  // Every file the header read, for callers that track dependencies themselves
+  std::vector<std::string> includes;
+};
+
+/**
+ * Parse and emit core of the generator for use in-process, by build orchestrators and editor integrations. Headers
+ * are parsed from disk, or from unsaved buffers registered for their path, and the generated sources are returned
+ * instead of written. Nothing is cached on disk.
+ * An instance is meant to stay alive: translation units are kept between calls and reparsed, so regenerating a
+ * header after an edit only redoes that header. Generating is safe from several threads at once. Names are only interned
+ * for the duration of a call, nothing of the headers seen stays behind between calls but their translation units.
+ */
+class CodeGenerator
+{
+public:
+  /** The parse options are taken as is, except that headers are always parsed with their includes */
+  CodeGenerator(std::vector<std::string> const &cxxFlags, ParseOptions const &options = ParseOptions(), uint32_t maxKeptUnits = 128);
+
+  ~CodeGenerator();
+
+  CodeGenerator(CodeGenerator const &) = delete;
+  CodeGenerator &operator=(CodeGenerator const &) = delete;
+
+  /** Reads contents instead of the file at this path in every later parse, the file does not need to exist */
+  void setUnsavedFile(std::string const &path, std::string const &contents);
+
+  /** Goes back to reading the file at this path from disk */
+  void removeUnsavedFile(std::string const &path);
+
+  void clearUnsavedFiles();
+
+  GeneratedSource generate(std::string const &headerPath);
+
+  /** Generates every header on its own worker thread, results are in the order of the paths */
+  std::vector<GeneratedSource> generate(std::vector<std::string> const &headerPaths, uint32_t numJobs = 0);
+
+protected:
+  /** Generates a header, interning its names in symbols */
+  GeneratedSource generate(std::string const &headerPath, std::shared_ptr<SymbolTable> const &symbols);
+
+  std::vector<std::string> m_cxxFlags;
+  ParseOptions m_options;
+
+  // Replaced as a whole on every change, so parses that already started keep the buffers they began with
+  std::mutex m_unsavedMutex;
+  std::shared_ptr<std::vector<UnsavedFile> const> m_unsavedFiles;
+};
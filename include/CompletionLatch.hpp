@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Single-use countdown, lets a thread sleep until a known amount of work has finished.
+ * Counting down is a single atomic decrement, the mutex is only touched by the final count and by waiters.
+ */
+class CompletionLatch
+{
+public:
+  CompletionLatch(uint64_t count);
+
+  /** Marks one unit of work as finished, wakes waiters once the count reaches zero */
+  void countDown();
+
+  /** Blocks until the count reaches zero */
+  void wait();
+
+  bool isDone() const;
+
+protected:
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::atomic_uint64_t m_count{0};
+};
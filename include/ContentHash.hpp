@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** FNV-1a offset basis, used as the seed for a fresh hash */
+constexpr uint64_t ContentHashSeed = 14695981039346656037ull;
+
+/** Hashes a block of memory, continuing from the given seed */
+uint64_t hashBytes(void const *data, uint64_t size, uint64_t seed = ContentHashSeed);
+
+/** Hashes a string, continuing from the given seed */
+uint64_t hashString(std::string const &value, uint64_t seed = ContentHashSeed);
+
+/** Hashes a list of strings, order and boundaries included */
+uint64_t hashStrings(std::vector<std::string> const &values, uint64_t seed = ContentHashSeed);
+
+/** Hashes the full contents of a file, returns false if it could not be read */
+bool hashFile(std::string const &path, uint64_t &outHash);
+
+/** Formats a hash as a fixed width hexadecimal string */
+std::string hashToString(uint64_t hash);
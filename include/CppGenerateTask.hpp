@@ -2,10 +2,12 @@
 #pragma once
 
 #include "CxxParse/HeaderFile.hpp"
+#include "GenerateSettings.hpp"
+#include "InheritanceGraph.hpp"
 
-#include <WIR/Async.hpp>
-
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -16,37 +18,130 @@ enum CppGenerateStatus : uint8_t
   GS_Error
 };
 
-class CppGenerateTask : public wir::AsyncTask
+class CppGenerateTask
 {
 public:
-  CppGenerateTask(std::string const &inputFile, std::string const &outputFile, std::vector<std::string> const &cxxFlags);
+  CppGenerateTask(std::string const &inputFile, std::string const &outputFile, GenerateSettings const *settings);
 
   virtual ~CppGenerateTask();
 
-  virtual void execute() override;
+  /** Parses and emits in one go */
+  void execute();
+
+  /** Parses the header, or loads it from the parse cache */
+  void parse();
+
+  /** Completes the inheritance data of a header parsed without its includes, call between parse() and emit() */
+  void resolveInheritance(InheritanceGraph const &graph);
+
+  /** Renders the generated source for a successfully parsed header, and writes it or hands it to the output writer */
+  void emit();
+
+  /** The generated source for a parsed header, empty if it declares no reflected classes */
+  static std::string renderSource(HeaderFile const &header);
+
+  /** Makes parse() collect the declarations of these tasks' headers from this task's translation unit as well */
+  void setHarvestedTasks(std::vector<CppGenerateTask *> const &harvestedTasks);
+
+  /** Takes a header harvested by another task; an invalid one leaves this task to be parsed on its own */
+  void adoptHeader(HeaderFile &&header, bool cacheHit);
+
+  /** Stores an adopted header in the parse cache, for headers that were parsed by another process */
+  void storeAdopted();
+
+  /** Skips parsing for a header known to produce no output, emit() then writes an empty source */
+  void skipParse();
+
+  inline bool wasSkipped() const
+  {
+    return m_skipped;
+  }
+
+  /** Whether the header has been parsed, by this task or by the task that harvested it */
+  inline bool isParsed() const
+  {
+    return m_parsed;
+  }
+
+  /** Whether the header came from another task's translation unit */
+  inline bool wasHarvested() const
+  {
+    return m_harvested;
+  }
 
   inline std::string const &getInputFile() const
   {
     return m_inputFile;
   }
 
+  inline std::string const &getOutputFile() const
+  {
+    return m_outputFile;
+  }
+
   inline HeaderFile const &getParsedHeader() const
   {
     return m_parsedHeader;
   }
 
+  /** Hands the parsed header over, the task is left without one */
+  inline HeaderFile takeParsedHeader()
+  {
+    return std::move(m_parsedHeader);
+  }
+
   inline CppGenerateStatus getGeneratedStatus()
   {
     return (CppGenerateStatus)m_generatedStatus.load();
   }
 
+  inline bool wasCacheHit() const
+  {
+    return m_cacheHit;
+  }
+
+  /** Whether emit() wrote the output, false when it already had the generated content */
+  inline bool wasOutputChanged() const
+  {
+    return m_outputChanged;
+  }
+
+  /** Headers besides the includes whose declarations the output was generated from */
+  inline std::vector<std::string> const &getExtraDependencies() const
+  {
+    return m_extraDependencies;
+  }
+
+  /** Wall time spent parsing and emitting, in microseconds */
+  inline uint64_t getDuration() const
+  {
+    return m_duration;
+  }
+
 protected:
+  void parseHeader();
+  void harvestHeaders();
+  bool loadCached(std::string &cacheKey);
+  void storeCached(std::string const &cacheKey);
+  void reportErrors();
+
+  /** Records how writing the rendered source went, on the writer thread if there is one */
+  void finishOutput(bool written, bool changed);
+
   // Input
   std::string m_inputFile;
   std::string m_outputFile;
-  std::vector<std::string> m_cxxFlags;
+  GenerateSettings const *m_settings = nullptr;
+  std::vector<CppGenerateTask *> m_harvestedTasks;
 
   // Output
+  bool m_cacheHit = false;
+  bool m_parsed = false;
+  bool m_harvested = false;
+  bool m_skipped = false;
+  bool m_outputChanged = false;
+  uint64_t m_duration = 0;
+  std::vector<std::string> m_extraDependencies;
   std::atomic_uint8_t m_generatedStatus{GS_Invalid};
   HeaderFile m_parsedHeader;
 };
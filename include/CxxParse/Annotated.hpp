@@ -1,21 +1,43 @@
-
 #pragma once
 
 #include <WIR/Stream.hpp>
 
+#include <cstddef>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+/**
+ * Declarations are move-only and allocate from the arena of the header that owns them. Moving one between arenas
+ * goes through the allocator-extended move constructors, which is what std::pmr containers call.
+ */
 class AnnotatedSymbol
 {
 public:
+  using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+  explicit AnnotatedSymbol(allocator_type const &allocator = {});
+  AnnotatedSymbol(AnnotatedSymbol &&other) = default;
+  AnnotatedSymbol(AnnotatedSymbol &&other, allocator_type const &allocator);
+  AnnotatedSymbol &operator=(AnnotatedSymbol &&other) = default;
+  AnnotatedSymbol(AnnotatedSymbol const &) = delete;
+  AnnotatedSymbol &operator=(AnnotatedSymbol const &) = delete;
+
   virtual ~AnnotatedSymbol();
   bool serialize(wir::Stream &toStream) const;
   bool deserialize(wir::Stream &fromStream);
 
-  void addAnnotation(std::string const &newAnnotation);
-  bool hasAnnotation(std::string const &reference);
+  void addAnnotation(std::string_view newAnnotation);
+  bool hasAnnotation(std::string_view reference) const;
+
+  /** In the order they were written, allocated from the same arena as the declaration */
+  inline std::span<std::pmr::string const> getAnnotations() const
+  {
+    return m_annotations;
+  }
 
 protected:
-  std::vector<std::string> m_annotations;
+  std::pmr::vector<std::pmr::string> m_annotations;
 };
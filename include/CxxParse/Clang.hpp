@@ -0,0 +1,201 @@
+#pragma once
+
+#include <clang-c/Index.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Thin ownership layer over the libclang C API.
+ * Every handle that libclang expects to be disposed is owned by exactly one move-only object here, and released when
+ * it goes out of scope, so long running processes do not accumulate strings, diagnostics or translation units.
+ */
+
+/** Owns a CXString */
+class ClangString
+{
+public:
+  ClangString();
+  explicit ClangString(CXString string);
+  ~ClangString();
+
+  ClangString(ClangString &&other) noexcept;
+  ClangString &operator=(ClangString &&other) noexcept;
+  ClangString(ClangString const &) = delete;
+  ClangString &operator=(ClangString const &) = delete;
+
+  /** The characters, empty for a null string, valid for as long as this object */
+  std::string_view view() const;
+
+  inline std::string str() const
+  {
+    return std::string(view());
+  }
+
+  bool isNull() const;
+
+protected:
+  CXString m_string = {};
+  bool m_owned = false;
+};
+
+/** A cursor, owns nothing but hands out owned strings */
+class ClangCursor
+{
+public:
+  ClangCursor();
+  ClangCursor(CXCursor cursor);
+
+  inline CXCursor get() const
+  {
+    return m_cursor;
+  }
+
+  bool isNull() const;
+  CXCursorKind kind() const;
+
+  ClangString spelling() const;
+  ClangString displayName() const;
+
+  ClangCursor semanticParent() const;
+  ClangCursor lexicalParent() const;
+  ClangCursor definition() const;
+  ClangCursor canonical() const;
+
+  CXSourceLocation location() const;
+  CXSourceRange extent() const;
+
+  /** The file the cursor is located in after macro expansion, null for builtins */
+  CXFile file() const;
+
+  void visitChildren(CXCursorVisitor visitor, CXClientData clientData) const;
+
+  bool operator==(ClangCursor const &other) const;
+  bool operator!=(ClangCursor const &other) const;
+
+protected:
+  CXCursor m_cursor;
+};
+
+/** Owns a CXDiagnostic */
+class ClangDiagnostic
+{
+public:
+  explicit ClangDiagnostic(CXDiagnostic diagnostic);
+  ~ClangDiagnostic();
+
+  ClangDiagnostic(ClangDiagnostic &&other) noexcept;
+  ClangDiagnostic &operator=(ClangDiagnostic &&other) noexcept;
+  ClangDiagnostic(ClangDiagnostic const &) = delete;
+  ClangDiagnostic &operator=(ClangDiagnostic const &) = delete;
+
+  CXDiagnosticSeverity severity() const;
+  ClangString spelling() const;
+
+  /** The full message with location, as the compiler would print it */
+  ClangString format() const;
+
+  /** Expansion location of the diagnostic, the file is null if it has none */
+  void location(CXFile &outFile, uint32_t &outLine, uint32_t &outColumn) const;
+
+protected:
+  CXDiagnostic m_diagnostic = nullptr;
+};
+
+/** Owns a CXTranslationUnit */
+class ClangTranslationUnit
+{
+public:
+  ClangTranslationUnit();
+  ~ClangTranslationUnit();
+
+  ClangTranslationUnit(ClangTranslationUnit &&other) noexcept;
+  ClangTranslationUnit &operator=(ClangTranslationUnit &&other) noexcept;
+  ClangTranslationUnit(ClangTranslationUnit const &) = delete;
+  ClangTranslationUnit &operator=(ClangTranslationUnit const &) = delete;
+
+  inline CXTranslationUnit get() const
+  {
+    return m_translationUnit;
+  }
+
+  /** Disposes the current translation unit and returns a slot for a parse function to fill */
+  CXTranslationUnit *reset();
+
+  inline bool isNull() const
+  {
+    return m_translationUnit == nullptr;
+  }
+
+  ClangCursor cursor() const;
+
+  uint32_t getNumDiagnostics() const;
+  ClangDiagnostic getDiagnostic(uint32_t index) const;
+
+  /** Writes the translation unit to disk, as a precompiled header or AST file */
+  bool save(std::string const &path) const;
+
+protected:
+  CXTranslationUnit m_translationUnit = nullptr;
+};
+
+/** Owns the tokens of a source range */
+class ClangTokens
+{
+public:
+  ClangTokens(CXTranslationUnit translationUnit, CXSourceRange range);
+  ~ClangTokens();
+
+  ClangTokens(ClangTokens const &) = delete;
+  ClangTokens &operator=(ClangTokens const &) = delete;
+
+  inline uint32_t size() const
+  {
+    return m_numTokens;
+  }
+
+  ClangString spelling(uint32_t index) const;
+
+protected:
+  CXTranslationUnit m_translationUnit = nullptr;
+  CXToken *m_tokens = nullptr;
+  uint32_t m_numTokens = 0;
+};
+
+/** Owns a CXIndex */
+class ClangIndex
+{
+public:
+  ClangIndex();
+  ~ClangIndex();
+
+  ClangIndex(ClangIndex const &) = delete;
+  ClangIndex &operator=(ClangIndex const &) = delete;
+
+  /** Created on first use */
+  CXIndex get();
+
+protected:
+  CXIndex m_index = nullptr;
+};
+
+/** Owns a CXIndexAction, which has to be disposed before the index it was created from */
+class ClangIndexAction
+{
+public:
+  ClangIndexAction();
+  ~ClangIndexAction();
+
+  ClangIndexAction(ClangIndexAction const &) = delete;
+  ClangIndexAction &operator=(ClangIndexAction const &) = delete;
+
+  /** Created on first use, from the given index */
+  CXIndexAction get(CXIndex index);
+
+protected:
+  CXIndexAction m_action = nullptr;
+};
+
+/** The name of a file, empty for a null file */
+ClangString getClangFileName(CXFile file);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+/**
+ * libclang is not linked, it is loaded the first time any clang_ function is called. Runs that find nothing stale
+ * never load it, or the LLVM libraries it pulls in.
+ * The library is taken from the WIR_LIBCLANG environment variable, or the path the generator was built against.
+ * Windows builds link libclang as usual.
+ */
+
+/** The path libclang is, or will be, loaded from */
+std::string getClangLibraryPath();
+
+/**
+ * Identifies the library file by its path, size and modification time, without loading it.
+ * Returns false if the file can not be found, e.g. when it is only known by name and left to the loader to find,
+ * and always on Windows, where it is linked.
+ */
+bool getClangLibraryIdentity(std::string &outIdentity);
@@ -1,13 +1,15 @@
-
 #pragma once
 
 #include "CxxParse/Annotated.hpp"
+#include "CxxParse/SymbolTable.hpp"
 
 #include <WIR/Stream.hpp>
 
 #include <cstdint>
-#include <stack>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 enum AccessSpecifier : uint8_t
@@ -20,12 +22,15 @@ enum AccessSpecifier : uint8_t
 class MethodDeclaration : public AnnotatedSymbol, public wir::Serializable
 {
 public:
-  MethodDeclaration();
-  MethodDeclaration(std::string const &name, AccessSpecifier accessSpec = AS_Public, bool pureVirtual = false);
+  explicit MethodDeclaration(allocator_type const &allocator = {});
+  MethodDeclaration(std::string_view name, AccessSpecifier accessSpec, bool pureVirtual, allocator_type const &allocator = {});
+  MethodDeclaration(MethodDeclaration &&other) = default;
+  MethodDeclaration(MethodDeclaration &&other, allocator_type const &allocator);
+  MethodDeclaration &operator=(MethodDeclaration &&other) = default;
 
-  std::string const &getName() const;
+  std::string_view getName() const;
 
-  void setName(std::string const &newValue);
+  void setName(std::string_view newValue);
 
   AccessSpecifier getAccessSpecifier() const;
 
@@ -39,7 +44,7 @@ public:
   virtual bool deserialize(wir::Stream &fromStream) override;
 
 protected:
-  std::string m_name;
+  std::pmr::string m_name;
   AccessSpecifier m_accessSpecifier = AS_Public;
   bool m_isPureVirtual = false;
 };
@@ -47,34 +52,43 @@ protected:
 class ClassDeclaration : public AnnotatedSymbol, public wir::Serializable
 {
 public:
-  ClassDeclaration();
-  ClassDeclaration(std::string const &newName, std::stack<std::string> ns, bool abstract);
+  /** Names are interned in symbols, which has to outlive the declaration */
+  explicit ClassDeclaration(SymbolTable &symbols, allocator_type const &allocator = {});
+  ClassDeclaration(SymbolTable &symbols, std::string_view newName, NamespaceId ns, bool abstract, allocator_type const &allocator = {});
+  ClassDeclaration(ClassDeclaration &&other) = default;
+  ClassDeclaration(ClassDeclaration &&other, allocator_type const &allocator);
+  ClassDeclaration &operator=(ClassDeclaration &&other) = default;
 
   virtual bool serialize(wir::Stream &toStream) const override;
   virtual bool deserialize(wir::Stream &fromStream) override;
 
-  bool isAbstract();
+  bool isAbstract() const;
 
-  std::string const &getName();
+  std::string const &getName() const;
 
-  void setName(std::string const &newValue);
+  void setName(std::string_view newValue);
 
-  std::vector<MethodDeclaration> const &getMethodDeclarations();
+  std::span<MethodDeclaration const> getMethodDeclarations() const;
 
-  std::vector<std::string> const &getBaseClasses();
+  /** Qualified unless taken as written, allocated from the same arena as the class */
+  std::span<std::pmr::string const> getBaseClasses() const;
 
-  void addMethodDeclaration(MethodDeclaration const &newDeclaration);
+  /** Constructed in place, from the same arena as the class */
+  MethodDeclaration &addMethodDeclaration(std::string_view name, AccessSpecifier accessSpec, bool pureVirtual);
 
-  void addBaseClass(std::string const &newBase);
+  void addBaseClass(std::string_view newBase);
 
-  std::stack<std::string> getNamespace() const;
+  NamespaceId getNamespace() const;
 
-  std::string getFullyQualifiedName() const;
+  /** Interned, built once when the declaration is created */
+  std::string const &getFullyQualifiedName() const;
 
 protected:
-  std::string m_name;
-  std::stack<std::string> m_namespace;
-  std::vector<MethodDeclaration> m_methodDeclarations;
-  std::vector<std::string> m_baseClasses;
+  SymbolTable *m_symbols = nullptr;
+  std::string const *m_name = nullptr;
+  std::string const *m_qualifiedName = nullptr;
+  NamespaceId m_namespace = SymbolTable::GlobalNamespace;
+  std::pmr::vector<MethodDeclaration> m_methodDeclarations;
+  std::pmr::vector<std::pmr::string> m_baseClasses;
   bool m_abstract = false;
 };
@@ -1,36 +1,61 @@
-
 #pragma once
 
 #include <WIR/Stream.hpp>
 
 #include "CxxParse/Annotated.hpp"
+#include "CxxParse/SymbolTable.hpp"
 
+#include <cstddef>
 #include <cstdint>
-#include <map>
-#include <stack>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
+
+/** Allocator-aware like the declarations, its name lives in the same arena as the enum */
+struct EnumVariable
+{
+  using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+  EnumVariable(std::string_view inName, int64_t inValue, allocator_type const &allocator = {});
+  EnumVariable(EnumVariable &&other) = default;
+  EnumVariable(EnumVariable &&other, allocator_type const &allocator);
+  EnumVariable &operator=(EnumVariable &&other) = default;
+
+  std::pmr::string name;
+  int64_t value = 0;
+};
 
 class EnumDeclaration : public wir::Serializable, public AnnotatedSymbol
 {
 public:
-  EnumDeclaration();
-  EnumDeclaration(std::string const &name, std::stack<std::string> ns);
+  /** Names are interned in symbols, which has to outlive the declaration */
+  explicit EnumDeclaration(SymbolTable &symbols, allocator_type const &allocator = {});
+  EnumDeclaration(SymbolTable &symbols, std::string_view name, NamespaceId ns, allocator_type const &allocator = {});
+  EnumDeclaration(EnumDeclaration &&other) = default;
+  EnumDeclaration(EnumDeclaration &&other, allocator_type const &allocator);
+  EnumDeclaration &operator=(EnumDeclaration &&other) = default;
 
-  std::string const &getName();
+  std::string const &getName() const;
 
-  void setName(std::string const &newName);
+  void setName(std::string_view newName);
 
-  std::map<std::string, int64_t> const &getVariables();
+  /** Sorted by name */
+  std::span<EnumVariable const> getVariables() const;
 
-  void addVariable(std::string const &variableName, int64_t value);
+  void addVariable(std::string_view variableName, int64_t value);
 
   virtual bool serialize(wir::Stream &toStream) const override;
   virtual bool deserialize(wir::Stream &fromStream) override;
 
-  std::string getFullyQualifiedName() const;
+  /** Interned, built once when the declaration is created */
+  std::string const &getFullyQualifiedName() const;
 
 protected:
-  std::string m_name;
-  std::stack<std::string> m_namespace;
-  std::map<std::string, int64_t> m_variables;
+  SymbolTable *m_symbols = nullptr;
+  std::string const *m_name = nullptr;
+  std::string const *m_qualifiedName = nullptr;
+  NamespaceId m_namespace = SymbolTable::GlobalNamespace;
+  std::pmr::vector<EnumVariable> m_variables;
 };
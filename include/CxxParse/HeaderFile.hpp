@@ -6,9 +6,15 @@
 
 #include <WIR/Stream.hpp>
 
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <set>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 enum HeaderMessageSeverity
@@ -22,7 +28,7 @@ enum HeaderMessageSeverity
 
 struct HeaderMessage
 {
-  std::string prettyPrint();
+  std::string prettyPrint() const;
 
   std::string message;
   std::string filename;
@@ -31,34 +37,151 @@ struct HeaderMessage
   HeaderMessageSeverity severity = MS_Ignored;
 };
 
+enum ParseProfile : uint8_t
+{
+  // Skips function bodies and only collects errors, for regular generation
+  PP_Fast,
+
+  // Full fidelity parse with every diagnostic, for debugging
+  PP_Full
+};
+
+enum ParseEngine : uint8_t
+{
+  // Walks the whole AST of every translation unit with clang_visitChildren
+  PE_Visitor,
+
+  // Receives declarations from the libclang indexer, which skips bodies already parsed on the same worker
+  PE_Indexer
+};
+
+class PrecompiledPreamble;
+class TranslationUnitPool;
+
+/** Contents that stand in for a file on disk while parsing, such as a buffer an editor has not saved yet */
+struct UnsavedFile
+{
+  std::string path;
+  std::string contents;
+};
+
+struct ParseOptions
+{
+  /** Identifies everything in the options that can change the result of a parse */
+  std::string getKey() const;
+
+  ParseProfile profile = PP_Fast;
+
+  // How declarations are extracted, both fill in the same data
+  ParseEngine engine = PE_Visitor;
+
+  // Parse without following includes, base classes are then taken as written and resolved through an InheritanceGraph
+  bool singleFile = false;
+
+  // Optional, parsed on top of this instead of reprocessing the headers it contains
+  std::shared_ptr<PrecompiledPreamble const> preamble;
+
+  // Optional, translation units are kept here after parsing and reparsed the next time their header is parsed
+  std::shared_ptr<TranslationUnitPool> units;
+
+  // Optional, read instead of the files on disk with the same path. Not part of the key, parses that use these
+  // must not go through the parse cache.
+  std::shared_ptr<std::vector<UnsavedFile> const> unsavedFiles;
+
+  // Optional, the names of the run are interned here and the headers keep it alive. Without one, every parse interns
+  // into a table of its own. Not part of the key.
+  std::shared_ptr<SymbolTable> symbols;
+};
+
+/**
+ * Owns the declarations of a header, and the arena they allocate from. Move-only, the declarations stay where they are
+ * when the header moves, and are released all at once with it.
+ */
 class HeaderFile : public wir::Serializable
 {
 public:
   HeaderFile();
-  HeaderFile(std::string const &inHeaderFilePath, std::vector<std::string> const &cxxFlagsExtra);
+
+  /** An empty header that interns the names of whatever is deserialized into it in the given table */
+  explicit HeaderFile(std::shared_ptr<SymbolTable> symbols);
+
+  HeaderFile(std::string const &inHeaderFilePath, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options = ParseOptions());
+
+  HeaderFile(HeaderFile &&other) = default;
+  HeaderFile &operator=(HeaderFile &&other) = default;
+  HeaderFile(HeaderFile const &) = delete;
+  HeaderFile &operator=(HeaderFile const &) = delete;
+
+  /**
+   * Parses the root header once, and collects the declarations of every harvested header from the same translation unit.
+   * Returns a header for the root and for each harvested path; those the root did not include come back invalid.
+   */
+  static std::map<std::string, HeaderFile> harvest(std::string const &rootHeaderPath, std::vector<std::string> const &harvestedHeaderPaths, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options = ParseOptions());
+
+  /** A header that could not be parsed at all, with a single fatal message saying why */
+  static HeaderFile makeFailed(std::string const &headerPath, std::string const &message);
+
+  /** The complete flag set a header is parsed with, the built-in flags followed by the given extra flags */
+  static std::vector<std::string> getCompilerFlags(std::vector<std::string> const &cxxFlagsExtra);
+
+  /** Version string of the libclang in use, anything derived from a parse depends on it */
+  static std::string getParserVersion();
 
   void registerBaseClass(std::string const &childClassName, std::string const &parentClassName);
 
+  /** Every known class mapped to its direct bases, including classes declared outside this header */
+  inline std::map<std::string, std::set<std::string>> const &getInheritMap() const
+  {
+    return m_inheritMap;
+  }
+
+  void setInheritMap(std::map<std::string, std::set<std::string>> const &inheritMap);
+
+  /** Direct bases, or every class inherited from at any depth, sorted */
   std::set<std::string> getInheritedClassesFor(std::string const &className, bool topLevelOnly = false) const;
+
+  /** Looks up the precompiled closure, O(log n) once compiled */
   bool doesClassInherit(std::string const &className, std::string const &parentClass) const;
   bool doesAnyClassInherit(std::string const &parentClass) const;
 
-  void addClassDeclaration(ClassDeclaration const &newDecl);
-  void addEnumDeclaration(EnumDeclaration const &newDecl);
+  /** Constructed in place, in the arena of this header */
+  ClassDeclaration &addClassDeclaration(std::string_view name, NamespaceId ns, bool abstract);
+  EnumDeclaration &addEnumDeclaration(std::string_view name, NamespaceId ns);
 
   inline std::string const &getFilePath() const
   {
     return m_filePath;
   }
 
-  inline std::vector<ClassDeclaration> const &getClassDeclarations() const
+  inline std::span<ClassDeclaration const> getClassDeclarations() const
+  {
+    return m_declarations ? std::span<ClassDeclaration const>(m_declarations->classes) : std::span<ClassDeclaration const>();
+  }
+
+  inline std::span<EnumDeclaration const> getEnumDeclarations() const
+  {
+    return m_declarations ? std::span<EnumDeclaration const>(m_declarations->enums) : std::span<EnumDeclaration const>();
+  }
+
+  /** Every file the translation unit read besides the header itself, sorted */
+  inline std::vector<std::string> const &getIncludes() const
+  {
+    return m_includes;
+  }
+
+  /** Files the header itself includes, sorted */
+  inline std::vector<std::string> const &getDirectIncludes() const
   {
-    return m_classDeclarations;
+    return m_directIncludes;
   }
 
-  inline std::vector<EnumDeclaration> const &getEnumDeclarations() const
+  /**
+   * Content hash of the precompiled preamble the header was parsed on top of, 0 without one. What the preamble read
+   * is not among the includes, the header depends on the preamble as a whole instead.
+   */
+  inline uint64_t getPreambleHash() const
   {
-    return m_enumDeclarations;
+    return m_preambleHash;
   }
 
   inline std::vector<HeaderMessage> const &getMessages() const
@@ -71,17 +194,68 @@ public:
     return m_valid;
   }
 
+  /** Rewrites the paths below rootPath relative to it, so the header can be read on a host with the tree elsewhere */
+  void makePathsRelative(std::string const &rootPath);
+
+  /** Puts the relative paths of a header below rootPath, the opposite of makePathsRelative() */
+  void makePathsAbsolute(std::string const &rootPath);
+
   virtual bool serialize(wir::Stream &toStream) const override;
   virtual bool deserialize(wir::Stream &fromStream) override;
 
 protected:
+  struct Declarations
+  {
+    /** Allocates from the given resource instead of the arena, if there is one */
+    explicit Declarations(std::pmr::memory_resource *resource = nullptr);
+
+    // Never frees on its own, everything in it is released together when the header goes away
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::vector<ClassDeclaration> classes;
+    std::pmr::vector<EnumDeclaration> enums;
+  };
+
+  /** The declarations of this header, created on first use and after being moved from */
+  Declarations &getDeclarations();
+
+  /** The table the names of the declarations are interned in, a table of its own if it was given none */
+  SymbolTable &getSymbols();
+
+  /**
+   * Moves the declarations into a fresh arena, every container sized to fit. A parse builds them in a scratch pool of
+   * the worker, where buffers that were outgrown get reused, so nothing outgrown ends up held by the header.
+   */
+  void compactDeclarations();
+
+  void parseTranslationUnit(std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options, std::vector<HeaderFile *> const &harvestedHeaders);
+
+  /** Passes every path the header refers to through rewrite, keeping the include lists sorted */
+  void rewritePaths(std::function<void(std::string &path)> const &rewrite);
+
+  static constexpr uint32_t InvalidClassId = UINT32_MAX;
+
+  /** Builds the class ids and inheritance closures from m_inheritMap, unless they are current */
+  void compileInheritance() const;
+  uint32_t findClassId(std::string const &className) const;
+
   // key inherits from value, includes external declarations
   // Used to generate a complete set of baseclasses for the classes
   std::map<std::string, std::set<std::string>> m_inheritMap;
 
+  // Compiled from m_inheritMap on first use after it changed. Class ids index the sorted class names, and every
+  // class has the sorted ids of all the classes it inherits from at any depth.
+  mutable bool m_inheritanceCompiled = false;
+  mutable std::vector<std::string> m_classNames;
+  mutable std::vector<std::vector<uint32_t>> m_inheritClosure;
+
   bool m_valid = false;
   std::string m_filePath;
-  std::vector<ClassDeclaration> m_classDeclarations;
-  std::vector<EnumDeclaration> m_enumDeclarations;
+
+  // Declared before the declarations, which point into it and so go first
+  std::shared_ptr<SymbolTable> m_symbols;
+  std::unique_ptr<Declarations> m_declarations;
+  std::vector<std::string> m_includes;
+  std::vector<std::string> m_directIncludes;
+  uint64_t m_preambleHash = 0;
   std::vector<HeaderMessage> m_messages;
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FileHashCache.hpp"
+
+#include <WIR/Stream.hpp>
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * A precompiled header built from the headers most inputs include, shared by every translation unit of a run.
+ * The inputs then only pay for their own contents, instead of every parse reprocessing the same prelude.
+ */
+class PrecompiledPreamble : public wir::Serializable
+{
+public:
+  /** Picks the headers directly included by at least the given fraction of the inputs, most included first */
+  static std::vector<std::string> selectHeaders(std::vector<std::vector<std::string>> const &directIncludes, std::string const &excludedDirectory, double threshold);
+
+  /** Reuses the preamble in the cache directory if it is still current, otherwise builds it anew */
+  bool prepare(std::string const &cacheDirectory, std::vector<std::string> const &headers, std::vector<std::string> const &cxxFlagsExtra, FileHashCache &hashes);
+
+  /** Loads the preamble last prepared in the cache directory, returns whether nothing it read has changed since */
+  bool loadCurrent(std::string const &cacheDirectory, FileHashCache &hashes);
+
+  inline std::string const &getPchPath() const
+  {
+    return m_pchPath;
+  }
+
+  /** The headers the preamble was built from */
+  inline std::vector<std::string> const &getHeaders() const
+  {
+    return m_headers;
+  }
+
+  /** Every file the preamble read, inputs using it depend on all of them */
+  inline std::vector<std::string> const &getIncludes() const
+  {
+    return m_includes;
+  }
+
+  /**
+   * Identifies the preamble and the contents of every file it read. Inputs parsed on top of it depend on the preamble
+   * as a whole through this, instead of on each file it read.
+   */
+  inline uint64_t getContentHash() const
+  {
+    return m_contentHash;
+  }
+
+  /** A header read by the preamble cannot itself be parsed on top of it */
+  bool contains(std::string const &headerPath) const;
+
+  virtual bool serialize(wir::Stream &toStream) const override;
+  virtual bool deserialize(wir::Stream &fromStream) override;
+
+protected:
+  bool isCurrent(std::string const &pchPath, std::vector<std::string> const &headers, uint64_t flagsHash, FileHashCache &hashes) const;
+  bool areIncludesCurrent(FileHashCache &hashes) const;
+  void computeContentHash();
+  bool build(std::string const &preludePath, std::string const &pchPath, std::vector<std::string> const &cxxFlagsExtra);
+
+  std::string m_pchPath;
+  std::vector<std::string> m_headers;
+  uint64_t m_flagsHash = 0;
+  std::vector<std::string> m_includes;
+  std::vector<uint64_t> m_includeHashes;
+  std::set<std::string> m_includeSet;
+  uint64_t m_contentHash = 0;
+};
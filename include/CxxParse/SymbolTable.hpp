@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+typedef uint32_t NamespaceId;
+
+/**
+ * Interned names for the declaration model, shared by every header parsed in a run.
+ * Namespaces are nodes of one prefix tree, so declarations only hold the id of the namespace they are in, and
+ * qualified names are built once and then referenced. Everything handed out stays valid as long as the table, which
+ * every header holding its names keeps alive. A run owns one through its ParseOptions and drops it when it ends, so
+ * resident processes do not collect the names of every run they ever did.
+ */
+class SymbolTable
+{
+public:
+  static constexpr NamespaceId GlobalNamespace = 0;
+
+  SymbolTable();
+
+  SymbolTable(SymbolTable const &) = delete;
+  SymbolTable &operator=(SymbolTable const &) = delete;
+
+  /** The namespace with the given name inside the parent, created on first use */
+  NamespaceId getNamespace(NamespaceId parent, std::string_view name);
+
+  /** The namespace at the end of a path of names starting from the global namespace, outermost first */
+  NamespaceId getNamespace(std::vector<std::string> const &path);
+
+  /** Names of the namespace and its parents, outermost first, empty for the global namespace */
+  std::vector<std::string> getPath(NamespaceId ns) const;
+
+  /** The qualified name of the namespace, empty for the global namespace */
+  std::string const &getQualifiedName(NamespaceId ns) const;
+
+  /** The interned copy of a name */
+  std::string const &intern(std::string_view name);
+
+  /** The interned qualified name of a symbol declared in the namespace */
+  std::string const &intern(NamespaceId ns, std::string_view name);
+
+protected:
+  struct NamespaceNode
+  {
+    NamespaceId parent = GlobalNamespace;
+    std::string const *name = nullptr;
+    std::string const *qualifiedName = nullptr;
+    std::map<std::string_view, NamespaceId> children;
+  };
+
+  std::string const &internLocked(std::string_view name);
+
+  mutable std::shared_mutex m_mutex;
+
+  // Nodes never move once created, neither do the strings in the set
+  std::deque<NamespaceNode> m_namespaces;
+  std::set<std::string, std::less<>> m_strings;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "CxxParse/Clang.hpp"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Translation units kept alive between runs of a resident process, so a changed header is reparsed, on top of a
+ * preamble libclang keeps for its includes, instead of parsed from scratch.
+ * A unit is taken out of the pool while it is in use, so no two workers ever touch the same one. Once the pool is
+ * full, the unit returned least recently is disposed.
+ */
+class TranslationUnitPool
+{
+public:
+  TranslationUnitPool(uint32_t capacity);
+
+  TranslationUnitPool(TranslationUnitPool const &) = delete;
+  TranslationUnitPool &operator=(TranslationUnitPool const &) = delete;
+
+  /**
+   * The index pooled units are created from. Worker indices go away with their threads, this one outlives every
+   * unit in the pool.
+   */
+  CXIndex getIndex();
+
+  /** Takes out the unit of a header parsed with the same flags, returns false if there is none */
+  bool take(std::string const &path, std::vector<std::string> const &flags, ClangTranslationUnit &outUnit);
+
+  /** Returns a unit to the pool, replacing any other unit of the same header */
+  void put(std::string const &path, std::vector<std::string> const &flags, ClangTranslationUnit &&unit);
+
+protected:
+  struct PooledUnit
+  {
+    std::vector<std::string> flags;
+    ClangTranslationUnit unit;
+    uint64_t lastUse = 0;
+  };
+
+  // Declared first, so it is disposed after the units
+  ClangIndex m_index;
+  CXIndex m_indexHandle = nullptr;
+
+  std::mutex m_mutex;
+  std::map<std::string, PooledUnit> m_units;
+  uint64_t m_useCounter = 0;
+  uint32_t m_capacity = 0;
+};
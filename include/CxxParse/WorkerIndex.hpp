@@ -0,0 +1,15 @@
+#pragma once
+
+#include <clang-c/Index.h>
+
+/**
+ * The libclang index owned by the calling thread, created on first use and disposed when the thread exits.
+ * Every translation unit parsed on a worker shares it, instead of each parse creating (and leaking) its own.
+ */
+CXIndex getWorkerIndex();
+
+/**
+ * The indexing session owned by the calling thread, on top of its index. Bodies parsed once in a session are skipped
+ * by every later translation unit indexed with it.
+ */
+CXIndexAction getWorkerIndexAction();
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Filesystems with coarse timestamps can change an entry without changing its time. An entry read less than this many
+ * nanoseconds after it was modified is not trusted on its timestamp later, the same way git treats racily clean files.
+ */
+constexpr uint64_t RacyWindow = 2000000000ull;
+
+/** What is known about a file's contents at a given point in time */
+struct FileRecord
+{
+  uint64_t size = 0;
+
+  // 0 when the file changed too recently before it was hashed, the hash is then never reused on its timestamp
+  uint64_t modified = 0;
+  uint64_t hash = 0;
+};
+
+/** Reads the size and modification time of a file, returns false if it does not exist. Times are in nanoseconds. */
+bool statFile(std::string const &path, uint64_t &outSize, uint64_t &outModified);
+
+/** Reads the modification time of a directory, which changes whenever an entry is added, removed or renamed in it */
+bool statDirectory(std::string const &path, uint64_t &outModified);
+
+/** The current time, on the clock modification times are reported on */
+uint64_t getFileClockNow();
+
+/**
+ * Per-run, thread-safe memo of file content hashes.
+ * Seeded with the records from the previous run; a file whose size and modification time still
+ * match its record reuses the recorded hash, anything else is read and hashed again. Timestamps are
+ * only used to skip work, never to decide that a file changed, and a file modified within RacyWindow
+ * of being hashed is hashed again every time until it settles.
+ */
+class FileHashCache
+{
+public:
+  FileHashCache();
+  FileHashCache(std::map<std::string, FileRecord> const &previousRecords);
+
+  /** Returns the current record for a file, returns false if it could not be read */
+  bool getRecord(std::string const &path, FileRecord &outRecord);
+
+  /** Returns the current content hash of a file, returns false if it could not be read */
+  bool getHash(std::string const &path, uint64_t &outHash);
+
+protected:
+  std::mutex m_mutex;
+  std::map<std::string, FileRecord> m_previousRecords;
+  std::unordered_map<std::string, FileRecord> m_records;
+  std::unordered_map<std::string, bool> m_missing;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct FileWatchEvents
+{
+  // Files written, and files or directories created, removed or renamed
+  std::set<std::string> changedPaths;
+
+  // Files or directories were added or removed, a listing of the tree is out of date
+  bool treeChanged = false;
+
+  // Changes were lost along the way, anything in the tree may have changed
+  bool overflowed = false;
+};
+
+/**
+ * Watches directory trees for changes, through inotify on Linux and by polling timestamps elsewhere.
+ * Directories created inside the trees are watched as they appear.
+ */
+class FileWatcher
+{
+public:
+  FileWatcher(std::string const &rootDirectory);
+  ~FileWatcher();
+
+  FileWatcher(FileWatcher const &) = delete;
+  FileWatcher &operator=(FileWatcher const &) = delete;
+
+  inline bool isValid() const
+  {
+    return m_valid;
+  }
+
+  /** Watches another tree besides the root directory, such as an include path the inputs depend on */
+  void addTree(std::string const &directory);
+
+  /**
+   * Blocks until something in the tree changes, then keeps collecting until nothing changed for the settle time,
+   * so one save that touches several files is reported once. Returns false if the tree can no longer be watched.
+   */
+  bool waitForChanges(FileWatchEvents &outEvents, uint32_t settleMilliseconds = 100);
+
+protected:
+  void watchTree(std::string const &directory);
+
+  std::string m_rootDirectory;
+  bool m_valid = false;
+
+#ifdef __linux__
+  bool readEvents(FileWatchEvents &outEvents, int32_t timeoutMilliseconds);
+
+  int m_inotify = -1;
+  std::map<int, std::string> m_watchedDirectories;
+#else
+  struct FileStamp
+  {
+    uint64_t size = 0;
+    uint64_t modified = 0;
+  };
+
+  bool pollChanges(FileWatchEvents &outEvents);
+
+  std::vector<std::string> m_polledDirectories;
+  std::map<std::string, FileStamp> m_stamps;
+#endif
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+#include "FileHashCache.hpp"
+#include "OutputWriter.hpp"
+#include "ParseCache.hpp"
+#include "ParseWorkerPool.hpp"
+
+#include <string>
+#include <vector>
+
+/** Run-wide settings and shared state every generate task works with */
+struct GenerateSettings
+{
+  std::vector<std::string> cxxFlags;
+  ParseOptions parseOptions;
+
+  FileHashCache *fileHashes = nullptr;
+
+  // Optional, parses are not cached if null
+  ParseCache const *parseCache = nullptr;
+
+  // Optional, outputs are written by the emitting worker itself if null
+  OutputWriter *outputWriter = nullptr;
+
+  // Optional, headers are parsed on the worker thread itself if null
+  ParseWorkerPool *parseWorkers = nullptr;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "BuildManifest.hpp"
+
+#include <string>
+#include <vector>
+
+/** One translation unit to parse, and the other stale headers to collect declarations for from it */
+struct HarvestPlan
+{
+  std::string rootHeader;
+  std::vector<std::string> harvestedHeaders;
+};
+
+/**
+ * Picks a small set of root headers whose translation units cover every stale header, so each header is parsed once
+ * per run rather than once per includer. Coverage comes from the include sets the manifest recorded on the previous
+ * run; headers without history become roots of their own. Headers that turn out not to be included by their root
+ * anymore have to be parsed on their own afterwards.
+ */
+std::vector<HarvestPlan> planHarvest(std::vector<std::string> const &staleHeaders, BuildManifest const &manifest);
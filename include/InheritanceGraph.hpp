@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+
+#include <WIR/Stream.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Project-wide class hierarchy, persisted between runs.
+ * Every project header contributes the classes it declares along with their bases as written, and those are
+ * replaced wholesale whenever the header is parsed again. Classes outside the project are only known through
+ * parses that followed includes, and are kept per header the same way so stale ones go away with the next parse. Once resolved, it can complete the inheritance data of headers that were
+ * parsed without their includes.
+ */
+class InheritanceGraph : public wir::Serializable
+{
+public:
+  typedef std::map<std::string, std::set<std::string>> EdgeMap;
+
+  bool load(std::string const &path);
+  bool save(std::string const &path) const;
+
+  /**
+   * Takes over the classes a parsed header declares. A header parsed with its includes also replaces whatever it
+   * contributed about classes outside the project, one parsed without them leaves that as it was.
+   */
+  void learnFrom(HeaderFile const &header, bool includesFollowed);
+
+  /** Drops the contributions of headers that no longer exist */
+  void prune(std::set<std::string> const &existingHeaders);
+
+  /** Resolves every written base name against the known classes, call once everything has been learned */
+  void resolve();
+
+  /** Replaces the inheritance data of the header with the resolved edges reachable from its classes, returns the other project headers those came from */
+  std::vector<std::string> applyTo(HeaderFile &header) const;
+
+  virtual bool serialize(wir::Stream &toStream) const override;
+  virtual bool deserialize(wir::Stream &fromStream) override;
+
+protected:
+  std::string resolveName(std::string const &writtenName, std::string const &derivedClass, std::set<std::string> const &knownClasses) const;
+
+  // Header path mapped to the classes it declares, each with its bases as written
+  std::map<std::string, EdgeMap> m_headerEdges;
+
+  // Header path mapped to the classes outside the project its last full parse saw, fully qualified
+  std::map<std::string, EdgeMap> m_externalEdges;
+
+  // Derived by resolve()
+  EdgeMap m_resolvedEdges;
+  std::map<std::string, std::string> m_classOrigins;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Dedicated thread that commits generated sources to disk, so workers hand off rendered buffers instead of waiting on
+ * the filesystem. Whatever has queued up is written as one batch: the directories of the batch are created once
+ * each, then every file is written if its content changed.
+ */
+class OutputWriter
+{
+public:
+  /** Called on the writer thread once the file is committed, or failed to be */
+  typedef std::function<void(bool written, bool changed)> Completion;
+
+  OutputWriter();
+
+  /** Writes everything still queued, then joins the writer thread */
+  ~OutputWriter();
+
+  OutputWriter(OutputWriter const &) = delete;
+  OutputWriter &operator=(OutputWriter const &) = delete;
+
+  void submit(std::string const &path, std::string &&content, Completion onComplete);
+
+  /** Blocks until everything submitted so far is written and its completion has run */
+  void flush();
+
+protected:
+  struct Output
+  {
+    std::string path;
+    std::string directory;
+    std::string content;
+    Completion onComplete;
+  };
+
+  void writerLoop();
+  void writeBatch(std::vector<Output> &batch);
+
+  std::thread m_thread;
+
+  std::mutex m_mutex;
+  std::condition_variable m_queueCondition;
+  std::condition_variable m_flushCondition;
+  std::vector<Output> m_queue;
+
+  // Submitted outputs whose completion has not run yet
+  uint64_t m_pending = 0;
+  bool m_stopping = false;
+
+  // Directories known to exist, only touched by the writer thread
+  std::set<std::string> m_createdDirectories;
+};
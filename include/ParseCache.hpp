@@ -0,0 +1,40 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+#include "FileHashCache.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Persistent on-disk cache of parsed headers.
+ * Entries are keyed on the header contents, the full compiler flag set, the parse options and the libclang version.
+ * Each entry also records the contents of every file the parse read, and is only used if those
+ * still match, so a hit can be used in place of a parse without any further validation.
+ */
+class ParseCache
+{
+public:
+  ParseCache(std::string const &cacheDirectory);
+
+  /** Computes the cache key for the given header, returns an empty string if the header could not be read */
+  std::string computeKey(std::string const &headerPath, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options, FileHashCache &hashes) const;
+
+  /** Loads a cached header, interning its names in symbols. Returns false on a miss or if any of its includes changed */
+  bool load(std::string const &key, std::shared_ptr<SymbolTable> const &symbols, HeaderFile &outHeader, FileHashCache &hashes) const;
+
+  /** Stores a parsed header, only valid headers are stored */
+  bool store(std::string const &key, HeaderFile const &header, FileHashCache &hashes) const;
+
+  inline std::string const &getDirectory() const
+  {
+    return m_directory;
+  }
+
+protected:
+  std::string getEntryPath(std::string const &key) const;
+
+  std::string m_directory;
+  uint64_t m_environmentHash = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Parses headers in separate worker processes instead of on the calling thread, so no two parses share libclang's
+ * allocator or global state, and a header that crashes the parser or balloons its memory only takes its worker down.
+ * Workers are this executable started again in worker mode, and are kept running between parses. Each takes one
+ * request at a time over its own socket and answers with the serialized headers. A worker whose resident memory
+ * has grown past the recycle threshold is retired after its answer, and one that dies is replaced on next use.
+ * Workers are also bounded while they parse: their address space is limited to a multiple of the recycle threshold,
+ * and one that has not answered by the deadline is killed, failing the headers of its request.
+ * Only available on Linux; elsewhere the pool is never valid.
+ */
+class ParseWorkerPool
+{
+public:
+  /** The descriptor a worker talks to its supervisor on */
+  static constexpr int WorkerDescriptor = 3;
+
+  /** A timeout of 0 lets a parse take as long as it takes */
+  ParseWorkerPool(uint32_t numWorkers, uint64_t recycleBytes, uint32_t timeoutSeconds);
+
+  /** Closes every worker's socket, which makes them exit, and reaps them */
+  ~ParseWorkerPool();
+
+  ParseWorkerPool(ParseWorkerPool const &) = delete;
+  ParseWorkerPool &operator=(ParseWorkerPool const &) = delete;
+
+  bool isValid() const;
+
+  /**
+   * Same as HeaderFile::harvest, but in a worker; blocks until a worker is free and has answered. The preamble and the
+   * translation unit pool of the options are not used. If the worker dies, every header comes back failed.
+   */
+  std::map<std::string, HeaderFile> parse(std::string const &rootHeaderPath, std::vector<std::string> const &harvestedHeaderPaths, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options);
+
+  /** Workers started so far, including replacements */
+  uint64_t getNumSpawned() const;
+
+  /** Workers retired for their memory use */
+  uint64_t getNumRecycled() const;
+
+  /** Workers that died while parsing */
+  uint64_t getNumCrashed() const;
+
+  /** Workers killed for not answering in time */
+  uint64_t getNumTimedOut() const;
+
+  /** The main loop of a worker process, answers requests until the supervisor goes away. Returns the exit code. */
+  static int runWorker();
+
+protected:
+  struct Worker
+  {
+    int pid = -1;
+    int socket = -1;
+    bool busy = false;
+  };
+
+  bool spawn(Worker &worker);
+
+  /** Stops a worker and reaps it, returns its wait status */
+  int retire(Worker &worker, bool kill);
+
+  std::string m_executablePath;
+  uint64_t m_recycleBytes = 0;
+  uint64_t m_addressSpaceBytes = 0;
+  uint32_t m_timeoutSeconds = 0;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_idleCondition;
+  std::vector<Worker> m_workers;
+
+  uint64_t m_numSpawned = 0;
+  uint64_t m_numRecycled = 0;
+  uint64_t m_numCrashed = 0;
+  uint64_t m_numTimedOut = 0;
+};
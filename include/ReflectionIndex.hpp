@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+
+#include <WIR/Stream.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Names of the classes known to derive from wir::Class, persisted between runs.
+ * Lets headers be ruled out with a textual scan: a header whose class declarations never name one of these (or a
+ * class that in turn does) as a base can not produce any output, and does not need to be parsed. Names are kept
+ * unqualified, so the scan errs on the side of parsing.
+ */
+class ReflectionIndex : public wir::Serializable
+{
+public:
+  bool load(std::string const &path);
+  bool save(std::string const &path) const;
+
+  /** Whether anything was learned yet, a scan against an empty index would miss every class outside the project */
+  inline bool isEmpty() const
+  {
+    return m_headerClasses.empty();
+  }
+
+  /** Whether the header was parsed or scanned since the index was started */
+  inline bool hasHeader(std::string const &headerPath) const
+  {
+    return m_headerClasses.find(headerPath) != m_headerClasses.end();
+  }
+
+  /** Takes over the classes a parsed header declares that derive from wir::Class, and those it knows of outside the project */
+  void learnFrom(HeaderFile const &header);
+
+  /** Records that a header was ruled out by the scan, and so declares none */
+  void learnSkipped(std::string const &headerPath);
+
+  /** Drops the contributions of headers that no longer exist */
+  void prune(std::set<std::string> const &existingHeaders);
+
+  /** Every known name, wir::Class itself included */
+  std::set<std::string> getClassNames() const;
+
+  /** Identifies the current set of names, decisions made by a scan are only valid as long as it stays the same */
+  uint64_t getHash() const;
+
+  /**
+   * Scans the headers and returns those that may declare a class deriving from wir::Class. Classes found to match
+   * count as known for the remaining headers, so chains of new classes within the same run are followed.
+   */
+  std::set<std::string> scan(std::vector<std::string> const &headerPaths) const;
+
+  virtual bool serialize(wir::Stream &toStream) const override;
+  virtual bool deserialize(wir::Stream &fromStream) override;
+
+protected:
+  // Header path mapped to the unqualified names of the classes it declares that derive from wir::Class
+  std::map<std::string, std::set<std::string>> m_headerClasses;
+
+  // Unqualified names of such classes declared outside the project
+  std::set<std::string> m_externalClasses;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <WIR/Stream.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Serializes an object into a flat byte buffer */
+bool serializeToBytes(wir::Serializable const &object, std::vector<uint8_t> &outBytes);
+
+/**
+ * Deserializes an object from a flat byte buffer. A corrupt buffer makes this return false, whatever the object's
+ * deserialize throws on the way is caught here.
+ */
+bool deserializeFromBytes(std::vector<uint8_t> const &bytes, wir::Serializable &object);
+
+/** Throws std::length_error for an element count that the buffer being deserialized is too small to hold */
+void checkCount(uint64_t count);
+
+/** Reads the element count written ahead of a list, checked before anything is reserved for it */
+template <typename Count = uint64_t>
+Count readCount(wir::Stream &fromStream)
+{
+  Count count = 0;
+  fromStream >> count;
+  checkCount(uint64_t(count));
+  return count;
+}
+
+/** A temporary path next to the given one, unique across threads and across processes sharing the directory */
+std::string makeTempPath(std::string const &path);
+
+/**
+ * Writes a file through a temporary file in the same directory, so readers never see a partial write.
+ * Creates the directory first, unless the caller already made sure it exists.
+ */
+bool writeFileAtomic(std::string const &path, void const *data, uint64_t size, bool createPath = true);
+
+/**
+ * Writes a file only if its content differs from what is on disk, leaving an identical file and its modification time
+ * untouched. Writes go through writeFileAtomic; outChanged tells whether the file was written.
+ */
+bool writeFileIfChanged(std::string const &path, std::string_view content, bool &outChanged, bool createPath = true);
+
+/** Serializes an object to disk, through a temporary file so readers never see a partial write */
+bool writeSerializable(std::string const &path, wir::Serializable const &object);
+
+/** Deserializes an object from disk, returns false if the file is missing or unreadable */
+bool readSerializable(std::string const &path, wir::Serializable &object);
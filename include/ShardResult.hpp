@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CxxParse/HeaderFile.hpp"
+#include "FileHashCache.hpp"
+
+#include <WIR/Stream.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** What a shard parsed for one of its headers */
+struct ShardEntry
+{
+  /** Stores the paths below rootPath relative to it, so the merge can find them wherever it sees the tree */
+  void makePathsRelative(std::string const &rootPath);
+  void makePathsAbsolute(std::string const &rootPath);
+
+  /**
+   * Records the contents the header and its includes have now, relative paths taken below rootPath. Returns false if
+   * any of them could not be read. Call on relative paths, the hashes follow the order of the stored includes.
+   */
+  bool recordHashes(std::string const &rootPath, FileHashCache &hashes);
+
+  /** Whether the header and its includes still have the contents the shard parsed them with, call on relative paths */
+  bool matchesHashes(std::string const &rootPath, FileHashCache &hashes) const;
+
+  std::string inputFile;
+
+  // Wall time of the parse in microseconds, 0 if it came from the parse cache or was harvested
+  uint64_t duration = 0;
+
+  // Content hashes of the header and of header.getIncludes(), in the same order
+  uint64_t headerHash = 0;
+  std::vector<uint64_t> includeHashes;
+
+  HeaderFile header;
+};
+
+/**
+ * The headers one shard of a sharded run parsed, merged on a single host afterwards. Shards only parse; everything
+ * derived from the whole project (the inheritance graph, the reflection index, the outputs and the manifest) is built
+ * by the merge. Paths below the input root are stored relative to it, so the merge may see the tree at another path;
+ * paths outside of it, like system headers, are stored as they are.
+ */
+class ShardResult : public wir::Serializable
+{
+public:
+  bool load(std::string const &path);
+  bool save(std::string const &path) const;
+
+  /** Hash of the flags and parse options, shards parsed with different ones can not be merged */
+  static uint64_t computeOptionsHash(std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options);
+
+  virtual bool serialize(wir::Stream &toStream) const override;
+  virtual bool deserialize(wir::Stream &fromStream) override;
+
+  uint64_t optionsHash = 0;
+  uint32_t shardIndex = 0;
+  uint32_t numShards = 0;
+  std::vector<ShardEntry> entries;
+
+  // Optional, the names of loaded headers are interned here
+  std::shared_ptr<SymbolTable> symbols;
+};
+
+/**
+ * The headers shard shardIndex of numShards parses. Headers are dealt out largest first, each to the shard with the
+ * fewest bytes so far, ties broken by their path below the root. Every host computes the same partition from the same
+ * tree without sharing anything; costs measured on previous runs would balance better, but differ between hosts.
+ */
+std::vector<std::string> selectShardHeaders(std::vector<std::string> const &headers, std::string const &rootPath, uint32_t shardIndex, uint32_t numShards, FileHashCache &hashes);
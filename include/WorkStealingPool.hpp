@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed-size thread pool with one job queue per worker.
+ * Submitted jobs are spread round-robin over the queues, and a worker whose own queue runs dry steals
+ * from the others, so no single queue lock is shared by every worker.
+ */
+class WorkStealingPool
+{
+public:
+  typedef std::function<void()> Job;
+
+  WorkStealingPool(uint32_t numWorkers);
+
+  /** Finishes all queued jobs, then joins the workers */
+  ~WorkStealingPool();
+
+  WorkStealingPool(WorkStealingPool const &) = delete;
+  WorkStealingPool &operator=(WorkStealingPool const &) = delete;
+
+  void submit(Job job);
+
+  inline uint32_t getNumWorkers() const
+  {
+    return (uint32_t)m_queues.size();
+  }
+
+  /** The default worker count, leaves some headroom for the rest of the build */
+  static uint32_t getDefaultNumWorkers();
+
+protected:
+  struct WorkerQueue
+  {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  void workerLoop(uint32_t index);
+  bool popJob(uint32_t index, Job &outJob);
+
+  std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+  std::vector<std::thread> m_threads;
+
+  // Jobs sitting in any queue, lets idle workers sleep without polling every queue
+  std::atomic_uint64_t m_queuedJobs{0};
+  std::atomic_uint64_t m_nextQueue{0};
+  std::atomic_bool m_stopping{false};
+
+  std::mutex m_sleepMutex;
+  std::condition_variable m_sleepCondition;
+};
@@ -0,0 +1,343 @@
+#include "BuildManifest.hpp"
+
+#include "ContentHash.hpp"
+#include "SerializableFile.hpp"
+
+namespace
+{
+  // Bump whenever the serialized layout changes, a mismatch starts from an empty manifest
+  uint32_t const manifestFormatVersion = 6;
+}
+
+bool BuildManifest::load(std::string const &path)
+{
+  BuildManifest loaded;
+  if (!readSerializable(path, loaded))
+  {
+    return false;
+  }
+
+  *this = std::move(loaded);
+  return true;
+}
+
+bool BuildManifest::save(std::string const &path) const
+{
+  return writeSerializable(path, *this);
+}
+
+uint64_t BuildManifest::computeFlagsHash(std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options)
+{
+  uint64_t hash = hashStrings({HeaderFile::getParserVersion(), options.getKey()});
+  return hashStrings(HeaderFile::getCompilerFlags(cxxFlagsExtra), hash);
+}
+
+bool BuildManifest::isStale(std::string const &inputFile, std::string const &outputFile, uint64_t flagsHash, uint64_t preambleHash, FileHashCache &hashes) const
+{
+  auto entry = m_entries.find(inputFile);
+  if (entry == m_entries.end() || entry->second.outputFile != outputFile || entry->second.flagsHash != flagsHash)
+  {
+    return true;
+  }
+
+  if (entry->second.preambleHash != 0 && entry->second.preambleHash != preambleHash)
+  {
+    return true;
+  }
+
+  uint64_t outputSize = 0;
+  uint64_t outputModified = 0;
+  if (!statFile(outputFile, outputSize, outputModified))
+  {
+    return true;
+  }
+
+  for (auto const &dependency : entry->second.dependencies)
+  {
+    auto record = m_files.find(dependency);
+    uint64_t currentHash = 0;
+    if (record == m_files.end() || !hashes.getHash(dependency, currentHash) || currentHash != record->second.hash)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void BuildManifest::update(std::string const &inputFile, std::string const &outputFile, uint64_t flagsHash, std::vector<std::string> const &dependencies, std::vector<std::string> const &directIncludes, uint64_t preambleHash, FileHashCache &hashes)
+{
+  ManifestEntry &entry = m_entries[inputFile];
+  entry.outputFile = outputFile;
+  entry.flagsHash = flagsHash;
+  entry.directIncludes = directIncludes;
+  entry.preambleHash = preambleHash;
+  entry.dependencies.clear();
+
+  for (auto const &dependency : dependencies)
+  {
+    FileRecord record;
+    if (!hashes.getRecord(dependency, record))
+    {
+      // A dependency that vanished during the run can never match, so the next run regenerates
+      continue;
+    }
+
+    m_files[dependency] = record;
+    entry.dependencies.push_back(dependency);
+  }
+}
+
+void BuildManifest::remove(std::string const &inputFile)
+{
+  m_entries.erase(inputFile);
+}
+
+bool BuildManifest::prune(std::set<std::string> const &existingInputs)
+{
+  bool pruned = false;
+  for (auto it = m_generateCosts.begin(); it != m_generateCosts.end();)
+  {
+    if (existingInputs.find(it->first) == existingInputs.end())
+    {
+      it = m_generateCosts.erase(it);
+      pruned = true;
+    }
+    else
+    {
+      it++;
+    }
+  }
+
+  std::set<std::string> referenced;
+  for (auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    if (existingInputs.find(it->first) == existingInputs.end())
+    {
+      it = m_entries.erase(it);
+      pruned = true;
+      continue;
+    }
+
+    referenced.insert(it->second.dependencies.begin(), it->second.dependencies.end());
+    it++;
+  }
+
+  for (auto it = m_files.begin(); it != m_files.end();)
+  {
+    if (referenced.find(it->first) == referenced.end())
+    {
+      it = m_files.erase(it);
+      pruned = true;
+    }
+    else
+    {
+      it++;
+    }
+  }
+
+  return pruned;
+}
+
+bool BuildManifest::getInputHeaders(std::string const &rootPath, std::vector<std::string> &outHeaders) const
+{
+  if (m_inputTree.rootPath != rootPath || m_inputTree.directories.empty())
+  {
+    return false;
+  }
+
+  for (auto const &directory : m_inputTree.directories)
+  {
+    uint64_t modified = 0;
+    if (directory.second == 0 || !statDirectory(directory.first, modified) || modified != directory.second)
+    {
+      return false;
+    }
+  }
+
+  outHeaders = m_inputTree.headers;
+  return true;
+}
+
+void BuildManifest::setInputTree(InputTree const &tree)
+{
+  m_inputTree = tree;
+}
+
+ManifestEntry const *BuildManifest::findEntry(std::string const &inputFile) const
+{
+  auto finder = m_entries.find(inputFile);
+  if (finder == m_entries.end())
+  {
+    return nullptr;
+  }
+
+  return &finder->second;
+}
+
+void BuildManifest::setGenerateCost(std::string const &inputFile, uint64_t microseconds)
+{
+  m_generateCosts[inputFile] = microseconds;
+}
+
+bool BuildManifest::getGenerateCost(std::string const &inputFile, uint64_t &outMicroseconds) const
+{
+  auto finder = m_generateCosts.find(inputFile);
+  if (finder == m_generateCosts.end())
+  {
+    return false;
+  }
+
+  outMicroseconds = finder->second;
+  return true;
+}
+
+bool BuildManifest::serialize(wir::Stream &toStream) const
+{
+  toStream << manifestFormatVersion;
+
+  toStream << (uint64_t)m_files.size();
+  for (auto const &file : m_files)
+  {
+    toStream << file.first;
+    toStream << file.second.size;
+    toStream << file.second.modified;
+    toStream << file.second.hash;
+  }
+
+  toStream << (uint64_t)m_entries.size();
+  for (auto const &entry : m_entries)
+  {
+    toStream << entry.first;
+    toStream << entry.second.outputFile;
+    toStream << entry.second.flagsHash;
+    toStream << (uint64_t)entry.second.dependencies.size();
+    for (auto const &dependency : entry.second.dependencies)
+    {
+      toStream << dependency;
+    }
+
+    toStream << (uint64_t)entry.second.directIncludes.size();
+    for (auto const &include : entry.second.directIncludes)
+    {
+      toStream << include;
+    }
+    toStream << entry.second.preambleHash;
+  }
+
+  toStream << (uint64_t)m_generateCosts.size();
+  for (auto const &cost : m_generateCosts)
+  {
+    toStream << cost.first;
+    toStream << cost.second;
+  }
+
+  toStream << m_inputTree.rootPath;
+  toStream << (uint64_t)m_inputTree.directories.size();
+  for (auto const &directory : m_inputTree.directories)
+  {
+    toStream << directory.first;
+    toStream << directory.second;
+  }
+
+  toStream << (uint64_t)m_inputTree.headers.size();
+  for (auto const &header : m_inputTree.headers)
+  {
+    toStream << header;
+  }
+
+  return true;
+}
+
+bool BuildManifest::deserialize(wir::Stream &fromStream)
+{
+  m_files.clear();
+  m_entries.clear();
+  m_generateCosts.clear();
+  m_inputTree = InputTree();
+
+  uint32_t version = 0;
+  fromStream >> version;
+  if (version != manifestFormatVersion)
+  {
+    return false;
+  }
+
+  uint64_t numFiles = 0;
+  fromStream >> numFiles;
+  for (uint64_t i = 0; i < numFiles; i++)
+  {
+    std::string path;
+    FileRecord record;
+    fromStream >> path;
+    fromStream >> record.size;
+    fromStream >> record.modified;
+    fromStream >> record.hash;
+    m_files[path] = record;
+  }
+
+  uint64_t numEntries = 0;
+  fromStream >> numEntries;
+  for (uint64_t i = 0; i < numEntries; i++)
+  {
+    std::string inputFile;
+    fromStream >> inputFile;
+
+    ManifestEntry &entry = m_entries[inputFile];
+    fromStream >> entry.outputFile;
+    fromStream >> entry.flagsHash;
+
+    uint64_t numDependencies = 0;
+    fromStream >> numDependencies;
+    for (uint64_t j = 0; j < numDependencies; j++)
+    {
+      std::string dependency;
+      fromStream >> dependency;
+      entry.dependencies.push_back(dependency);
+    }
+
+    uint64_t numDirectIncludes = 0;
+    fromStream >> numDirectIncludes;
+    for (uint64_t j = 0; j < numDirectIncludes; j++)
+    {
+      std::string include;
+      fromStream >> include;
+      entry.directIncludes.push_back(include);
+    }
+    fromStream >> entry.preambleHash;
+  }
+
+  uint64_t numCosts = 0;
+  fromStream >> numCosts;
+  for (uint64_t i = 0; i < numCosts; i++)
+  {
+    std::string inputFile;
+    uint64_t cost = 0;
+    fromStream >> inputFile;
+    fromStream >> cost;
+    m_generateCosts[inputFile] = cost;
+  }
+
+  fromStream >> m_inputTree.rootPath;
+  uint64_t numDirectories = 0;
+  fromStream >> numDirectories;
+  for (uint64_t i = 0; i < numDirectories; i++)
+  {
+    std::string directory;
+    uint64_t modified = 0;
+    fromStream >> directory;
+    fromStream >> modified;
+    m_inputTree.directories[directory] = modified;
+  }
+
+  uint64_t numHeaders = 0;
+  fromStream >> numHeaders;
+  for (uint64_t i = 0; i < numHeaders; i++)
+  {
+    std::string header;
+    fromStream >> header;
+    m_inputTree.headers.push_back(header);
+  }
+
+  return true;
+}
@@ -0,0 +1,150 @@
+#include "CodeGenerator.hpp"
+#include "CompletionLatch.hpp"
+#include "CppGenerateTask.hpp"
+#include "CxxParse/TranslationUnitPool.hpp"
+#include "WorkStealingPool.hpp"
+
+#include "WIR/Filesystem.hpp"
+
+#include <algorithm>
+
+CodeGenerator::CodeGenerator(std::vector<std::string> const &cxxFlags, ParseOptions const &options, uint32_t maxKeptUnits)
+{
+  m_cxxFlags = cxxFlags;
+  m_options = options;
+
+  // Base classes declared in other headers are only known from the includes, there is no inheritance graph here
+  m_options.singleFile = false;
+
+  // A preamble built from the files on disk would hide unsaved buffers of the headers it contains
+  m_options.preamble = nullptr;
+
+  if (maxKeptUnits > 0)
+  {
+    m_options.units = std::make_shared<TranslationUnitPool>(maxKeptUnits);
+  }
+  else
+  {
+    m_options.units = nullptr;
+  }
+
+  m_unsavedFiles = std::make_shared<std::vector<UnsavedFile> const>();
+}
+
+CodeGenerator::~CodeGenerator()
+{
+}
+
+void CodeGenerator::setUnsavedFile(std::string const &path, std::string const &contents)
+{
+  // libclang matches buffers to the paths it resolves includes to, which are the normalized ones
+  std::string filePath = wir::File(path).path();
+
+  std::scoped_lock lock(m_unsavedMutex);
+  auto unsavedFiles = std::make_shared<std::vector<UnsavedFile>>(*m_unsavedFiles);
+
+  auto it = std::find_if(unsavedFiles->begin(), unsavedFiles->end(), [&filePath](UnsavedFile const &file) { return file.path == filePath; });
+  if (it != unsavedFiles->end())
+  {
+    it->contents = contents;
+  }
+  else
+  {
+    unsavedFiles->push_back({filePath, contents});
+  }
+
+  m_unsavedFiles = std::move(unsavedFiles);
+}
+
+void CodeGenerator::removeUnsavedFile(std::string const &path)
+{
+  std::string filePath = wir::File(path).path();
+
+  std::scoped_lock lock(m_unsavedMutex);
+  auto unsavedFiles = std::make_shared<std::vector<UnsavedFile>>(*m_unsavedFiles);
+  std::erase_if(*unsavedFiles, [&filePath](UnsavedFile const &file) { return file.path == filePath; });
+  m_unsavedFiles = std::move(unsavedFiles);
+}
+
+void CodeGenerator::clearUnsavedFiles()
+{
+  std::scoped_lock lock(m_unsavedMutex);
+  m_unsavedFiles = std::make_shared<std::vector<UnsavedFile> const>();
+}
+
+GeneratedSource CodeGenerator::generate(std::string const &headerPath)
+{
+  return generate(headerPath, std::make_shared<SymbolTable>());
+}
+
+GeneratedSource CodeGenerator::generate(std::string const &headerPath, std::shared_ptr<SymbolTable> const &symbols)
+{
+  GeneratedSource result;
+  result.headerPath = wir::File(headerPath).path();
+
+  ParseOptions options = m_options;
+  options.symbols = symbols;
+  {
+    std::scoped_lock lock(m_unsavedMutex);
+    options.unsavedFiles = m_unsavedFiles;
+  }
+
+  try
+  {
+    HeaderFile header(result.headerPath, m_cxxFlags, options);
+    result.valid = header.isValid();
+    result.messages = header.getMessages();
+    result.includes = header.getIncludes();
+
+    if (result.valid)
+    {
+      result.source = CppGenerateTask::renderSource(header);
+    }
+  }
+  catch (std::exception &e)
+  {
+    HeaderMessage newMessage;
+    newMessage.message = e.what();
+    newMessage.filename = result.headerPath;
+    newMessage.severity = MS_Fatal;
+
+    result.valid = false;
+    result.source.clear();
+    result.messages.push_back(newMessage);
+  }
+
+  return result;
+}
+
+std::vector<GeneratedSource> CodeGenerator::generate(std::vector<std::string> const &headerPaths, uint32_t numJobs)
+{
+  std::vector<GeneratedSource> results(headerPaths.size());
+  if (headerPaths.empty())
+  {
+    return results;
+  }
+
+  if (numJobs == 0)
+  {
+    numJobs = WorkStealingPool::getDefaultNumWorkers();
+  }
+  numJobs = std::min(numJobs, (uint32_t)headerPaths.size());
+
+  // One table for the whole call, released once every header of it is done
+  auto symbols = std::make_shared<SymbolTable>();
+
+  CompletionLatch latch(headerPaths.size());
+  {
+    WorkStealingPool pool(numJobs);
+    for (size_t i = 0; i < headerPaths.size(); i++)
+    {
+      pool.submit([this, &headerPaths, &results, &latch, &symbols, i]() {
+        results[i] = generate(headerPaths[i], symbols);
+        latch.countDown();
+      });
+    }
+    latch.wait();
+  }
+
+  return results;
+}
@@ -0,0 +1,29 @@
+#include "CompletionLatch.hpp"
+
+CompletionLatch::CompletionLatch(uint64_t count)
+  : m_count(count)
+{
+}
+
+void CompletionLatch::countDown()
+{
+  if (m_count.fetch_sub(1) != 1)
+  {
+    return;
+  }
+
+  // Take the lock before notifying so a waiter between its check and its sleep cannot miss the wakeup
+  std::scoped_lock lock(m_mutex);
+  m_condition.notify_all();
+}
+
+void CompletionLatch::wait()
+{
+  std::unique_lock lock(m_mutex);
+  m_condition.wait(lock, [this]() { return m_count.load() == 0; });
+}
+
+bool CompletionLatch::isDone() const
+{
+  return m_count.load() == 0;
+}
@@ -0,0 +1,66 @@
+#include "ContentHash.hpp"
+
+#include <WIR/String.hpp>
+
+#include <fstream>
+
+uint64_t hashBytes(void const *data, uint64_t size, uint64_t seed)
+{
+  uint8_t const *bytes = (uint8_t const *)data;
+  uint64_t hash = seed;
+  for (uint64_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+uint64_t hashString(std::string const &value, uint64_t seed)
+{
+  return hashBytes(value.data(), value.size(), seed);
+}
+
+uint64_t hashStrings(std::vector<std::string> const &values, uint64_t seed)
+{
+  uint64_t hash = seed;
+  for (auto const &value : values)
+  {
+    uint64_t size = value.size();
+    hash = hashBytes(&size, sizeof(size), hash);
+    hash = hashString(value, hash);
+  }
+
+  return hash;
+}
+
+bool hashFile(std::string const &path, uint64_t &outHash)
+{
+  std::ifstream file(path, std::ios_base::binary);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  uint64_t hash = ContentHashSeed;
+  char buffer[64 * 1024];
+  while (file)
+  {
+    file.read(buffer, sizeof(buffer));
+    hash = hashBytes(buffer, (uint64_t)file.gcount(), hash);
+  }
+
+  if (file.bad())
+  {
+    return false;
+  }
+
+  outHash = hash;
+  return true;
+}
+
+std::string hashToString(uint64_t hash)
+{
+  return wir::format("%016llx", (unsigned long long)hash);
+}
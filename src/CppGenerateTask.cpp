@@ -1,17 +1,20 @@
 
 #include "CppGenerateTask.hpp"
+#include "SerializableFile.hpp"
 
 #include "WIR/Error.hpp"
 #include "WIR/Filesystem.hpp"
 
-#include <fstream>
+#include <chrono>
+#include <map>
+#include <sstream>
 
-CppGenerateTask::CppGenerateTask(std::string const &inputFile, std::string const &outputFile, std::vector<std::string> const &cxxFlags)
+CppGenerateTask::CppGenerateTask(std::string const &inputFile, std::string const &outputFile, GenerateSettings const *settings)
 {
   m_inputFile = wir::File(inputFile).path();
   m_outputFile = wir::File(outputFile).path();
   m_generatedStatus = GS_Invalid;
-  m_cxxFlags = cxxFlags;
+  m_settings = settings;
 }
 
 CppGenerateTask::~CppGenerateTask()
@@ -20,29 +23,229 @@ CppGenerateTask::~CppGenerateTask()
 
 void CppGenerateTask::execute()
 {
-  wir::Timer timer;
-  std::string flagsStr;
-  for (auto f : m_cxxFlags)
+  parse();
+  emit();
+}
+
+void CppGenerateTask::parse()
+{
+  if (m_skipped)
+  {
+    return;
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  try
+  {
+    parseHeader();
+  }
+  catch (std::exception &e)
+  {
+    LogError("Exception caught while parsing %s: %s", m_inputFile.c_str(), e.what());
+    m_generatedStatus = GS_Error;
+  }
+
+  m_duration += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void CppGenerateTask::emit()
+{
+  if (m_generatedStatus == GS_Error)
   {
-    flagsStr.append(f);
-    flagsStr.append(" ");
+    return;
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  std::string source;
+  bool rendered = false;
+  try
+  {
+    source = renderSource(m_parsedHeader);
+    rendered = true;
+  }
+  catch (std::exception &e)
+  {
+    LogError("Exception caught while generating %s: %s", m_outputFile.c_str(), e.what());
+    m_generatedStatus = GS_Error;
+  }
+
+  m_duration += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+  if (!rendered)
+  {
+    return;
+  }
+
+  // Nothing of this task is touched by the worker after the handoff, the writer finishes it
+  OutputWriter *outputWriter = m_settings->outputWriter;
+  if (outputWriter)
+  {
+    outputWriter->submit(m_outputFile, std::move(source), [this](bool written, bool changed) { finishOutput(written, changed); });
+    return;
   }
 
+  bool changed = false;
+  bool written = writeFileIfChanged(m_outputFile, source, changed);
+  finishOutput(written, changed);
+}
+
+void CppGenerateTask::parseHeader()
+{
   std::string inputFilename = wir::File(m_inputFile).name();
   std::string outputFilename = wir::File(m_outputFile).name();
 
+  if (!m_harvestedTasks.empty())
+  {
+    Log("Generating %s -> %s (harvesting %u headers)", inputFilename.c_str(), outputFilename.c_str(), (uint32_t)m_harvestedTasks.size());
+    harvestHeaders();
+    return;
+  }
+
   Log("Generating %s -> %s", inputFilename.c_str(), outputFilename.c_str());
 
-  // Parse the header
-  m_parsedHeader = HeaderFile(m_inputFile, m_cxxFlags);
+  // Parse the header, or pick it up from the parse cache if it was parsed before
+  std::string cacheKey;
+  m_cacheHit = loadCached(cacheKey);
+  if (!m_cacheHit)
+  {
+    if (m_settings->parseWorkers)
+    {
+      m_parsedHeader = std::move(m_settings->parseWorkers->parse(m_inputFile, {}, m_settings->cxxFlags, m_settings->parseOptions)[m_inputFile]);
+    }
+    else
+    {
+      m_parsedHeader = HeaderFile(m_inputFile, m_settings->cxxFlags, m_settings->parseOptions);
+    }
+    storeCached(cacheKey);
+  }
+
+  m_parsed = true;
+  reportErrors();
+}
+
+void CppGenerateTask::harvestHeaders()
+{
+  // Harvested headers that are in the parse cache don't need to be collected from the translation unit
+  std::vector<std::string> harvestedPaths;
+  std::vector<std::pair<CppGenerateTask *, std::string>> pending;
+  for (CppGenerateTask *task : m_harvestedTasks)
+  {
+    std::string cacheKey;
+    if (task->loadCached(cacheKey))
+    {
+      task->m_cacheHit = true;
+      task->m_parsed = true;
+      task->m_harvested = true;
+      continue;
+    }
+
+    harvestedPaths.push_back(task->m_inputFile);
+    pending.emplace_back(task, cacheKey);
+  }
+
+  std::string cacheKey;
+  m_cacheHit = loadCached(cacheKey);
+  if (m_cacheHit && pending.empty())
+  {
+    m_parsed = true;
+    reportErrors();
+    return;
+  }
+
+  std::map<std::string, HeaderFile> headers;
+  if (m_settings->parseWorkers)
+  {
+    headers = m_settings->parseWorkers->parse(m_inputFile, harvestedPaths, m_settings->cxxFlags, m_settings->parseOptions);
+  }
+  else
+  {
+    headers = HeaderFile::harvest(m_inputFile, harvestedPaths, m_settings->cxxFlags, m_settings->parseOptions);
+  }
+
+  if (!m_cacheHit)
+  {
+    m_parsedHeader = std::move(headers[m_inputFile]);
+    storeCached(cacheKey);
+  }
+
+  for (auto &task : pending)
+  {
+    task.first->adoptHeader(std::move(headers[task.first->m_inputFile]), false);
+    if (task.first->isParsed())
+    {
+      task.first->storeCached(task.second);
+    }
+  }
+
+  m_parsed = true;
+  reportErrors();
+}
+
+void CppGenerateTask::skipParse()
+{
+  m_skipped = true;
+  m_parsed = true;
+}
+
+void CppGenerateTask::setHarvestedTasks(std::vector<CppGenerateTask *> const &harvestedTasks)
+{
+  m_harvestedTasks = harvestedTasks;
+}
+
+void CppGenerateTask::adoptHeader(HeaderFile &&header, bool cacheHit)
+{
+  if (!header.isValid())
+  {
+    return;
+  }
+
+  m_parsedHeader = std::move(header);
+  m_cacheHit = cacheHit;
+  m_parsed = true;
+  m_harvested = true;
+}
+
+void CppGenerateTask::storeAdopted()
+{
+  ParseCache const *parseCache = m_settings->parseCache;
+  if (!parseCache || !m_parsed)
+  {
+    return;
+  }
+
+  storeCached(parseCache->computeKey(m_inputFile, m_settings->cxxFlags, m_settings->parseOptions, *m_settings->fileHashes));
+}
 
+bool CppGenerateTask::loadCached(std::string &cacheKey)
+{
+  ParseCache const *parseCache = m_settings->parseCache;
+  if (!parseCache)
+  {
+    return false;
+  }
+
+  cacheKey = parseCache->computeKey(m_inputFile, m_settings->cxxFlags, m_settings->parseOptions, *m_settings->fileHashes);
+  return !cacheKey.empty() && parseCache->load(cacheKey, m_settings->parseOptions.symbols, m_parsedHeader, *m_settings->fileHashes);
+}
+
+void CppGenerateTask::storeCached(std::string const &cacheKey)
+{
+  ParseCache const *parseCache = m_settings->parseCache;
+  if (parseCache && !cacheKey.empty() && m_parsedHeader.isValid() && !parseCache->store(cacheKey, m_parsedHeader, *m_settings->fileHashes))
+  {
+    LogWarning("Failed to store %s in the parse cache", wir::File(m_inputFile).name().c_str());
+  }
+}
+
+void CppGenerateTask::reportErrors()
+{
   if (!m_parsedHeader.isValid())
   {
     std::string ss;
-    auto msgs = m_parsedHeader.getMessages();
-    ss = wir::format("%u Errors when parsing %s:\n", msgs.size(), inputFilename.c_str());
+    auto const &msgs = m_parsedHeader.getMessages();
+    ss = wir::format("%u Errors when parsing %s:\n", msgs.size(), wir::File(m_inputFile).name().c_str());
 
-    for (auto msg : msgs)
+    for (auto const &msg : msgs)
     {
       ss += wir::format("\t%s\n", msg.prettyPrint().c_str());
     }
@@ -50,27 +253,32 @@ void CppGenerateTask::execute()
     Log("%s", ss.c_str());
 
     m_generatedStatus = GS_Error;
-    return;
   }
+}
 
-  auto parsedClasses = m_parsedHeader.getClassDeclarations();
-  auto parsedEnums = m_parsedHeader.getEnumDeclarations();
-
-  // If we parsed OK, generate the source file
-  wir::File(m_outputFile).createPath();
-  std::ofstream outputFile(m_outputFile, std::ios_base::binary);
-  if (!outputFile.is_open())
+void CppGenerateTask::resolveInheritance(InheritanceGraph const &graph)
+{
+  if (m_generatedStatus == GS_Error || m_skipped)
   {
-    LogError("Generation failed, could not open file for write (%s)", m_outputFile.c_str());
-    m_generatedStatus = GS_Error;
+    return;
   }
 
+  m_extraDependencies = graph.applyTo(m_parsedHeader);
+}
+
+std::string CppGenerateTask::renderSource(HeaderFile const &header)
+{
+  auto parsedClasses = header.getClassDeclarations();
+
+  // If we parsed OK, generate the source in memory, it is only written out if it differs from what is on disk
+  std::ostringstream outputFile;
+
   bool writtenHeader = false;
 
   uint64_t i = 0;
-  for (auto parsedClass : parsedClasses)
+  for (auto const &parsedClass : parsedClasses)
   {
-    if (!m_parsedHeader.doesClassInherit(parsedClass.getFullyQualifiedName(), "wir::Class"))
+    if (!header.doesClassInherit(parsedClass.getFullyQualifiedName(), "wir::Class"))
     {
       continue;
     }
@@ -78,7 +286,7 @@ void CppGenerateTask::execute()
     if (!writtenHeader)
     {
       outputFile << "\n/* File is automatically generated by WIR, any changes manually made will be lost. */\n\n";
-      outputFile << "#include \"" << wir::File(m_inputFile).path() << "\"\n";
+      outputFile << "#include \"" << header.getFilePath() << "\"\n";
 
       outputFile << "#include <WIR/Class.hpp>\n";
       outputFile << "#include <functional>\n";
@@ -90,7 +298,7 @@ void CppGenerateTask::execute()
     std::string basesTemplate;
 
     bool f = true;
-    for (auto b : m_parsedHeader.getInheritedClassesFor(parsedClass.getFullyQualifiedName(), true))
+    for (auto const &b : header.getInheritedClassesFor(parsedClass.getFullyQualifiedName(), true))
     {
 
       if (f)
@@ -105,7 +313,7 @@ void CppGenerateTask::execute()
     }
 
     f = true;
-    for (auto b : m_parsedHeader.getInheritedClassesFor(parsedClass.getFullyQualifiedName(), false))
+    for (auto const &b : header.getInheritedClassesFor(parsedClass.getFullyQualifiedName(), false))
     {
       if (f)
       {
@@ -165,10 +373,22 @@ void CppGenerateTask::execute()
     i++;
   }
 
-  outputFile.close();
+  return outputFile.str();
+}
 
+void CppGenerateTask::finishOutput(bool written, bool changed)
+{
+  if (!written)
+  {
+    LogError("Generation failed, could not write file (%s)", m_outputFile.c_str());
+    m_generatedStatus = GS_Error;
+    return;
+  }
+
+  // An identical file keeps its modification time, so nothing downstream rebuilds for it
+  m_outputChanged = changed;
   m_generatedStatus = GS_Completed;
 
-  auto seconds = timer.seconds();
-  Log("Generated %s in %.00f seconds", outputFilename.c_str(), seconds);
+  std::string outputFilename = wir::File(m_outputFile).name();
+  Log("Generated %s in %.00f seconds%s%s", outputFilename.c_str(), double(m_duration) / 1000000.0, m_skipped ? " (not parsed)" : m_cacheHit ? " (cached parse)" : "", m_outputChanged ? "" : " (unchanged)");
 }
@@ -1,12 +1,23 @@
 #include "CxxParse/Annotated.hpp"
+#include "SerializableFile.hpp"
+
+AnnotatedSymbol::AnnotatedSymbol(allocator_type const &allocator)
+    : m_annotations(allocator)
+{
+}
+
+AnnotatedSymbol::AnnotatedSymbol(AnnotatedSymbol &&other, allocator_type const &allocator)
+    : m_annotations(std::move(other.m_annotations), allocator)
+{
+}
 
 AnnotatedSymbol::~AnnotatedSymbol()
 {
 }
 
-bool AnnotatedSymbol::hasAnnotation(std::string const &reference)
+bool AnnotatedSymbol::hasAnnotation(std::string_view reference) const
 {
-  for (auto annotation : m_annotations)
+  for (auto const &annotation : m_annotations)
   {
     if (annotation == reference)
     {
@@ -17,22 +28,22 @@ bool AnnotatedSymbol::hasAnnotation(std::string const &reference)
   return false;
 }
 
-void AnnotatedSymbol::addAnnotation(const std::string &newAnnotation)
+void AnnotatedSymbol::addAnnotation(std::string_view newAnnotation)
 {
   if (hasAnnotation(newAnnotation))
   {
     return;
   }
 
-  m_annotations.push_back(newAnnotation);
+  m_annotations.emplace_back(newAnnotation);
 }
 
 bool AnnotatedSymbol::serialize(wir::Stream &toStream) const
 {
   toStream << (uint64_t)m_annotations.size();
-  for (auto a : m_annotations)
+  for (auto const &annotation : m_annotations)
   {
-    toStream << a;
+    toStream << std::string(annotation);
   }
 
   return true;
@@ -41,13 +52,13 @@ bool AnnotatedSymbol::serialize(wir::Stream &toStream) const
 bool AnnotatedSymbol::deserialize(wir::Stream &fromStream)
 {
   m_annotations.clear();
-  uint64_t numAnnotations = 0;
-  fromStream >> numAnnotations;
+  uint64_t numAnnotations = readCount(fromStream);
+  m_annotations.reserve(numAnnotations);
   for (uint64_t i = 0; i < numAnnotations; i++)
   {
     std::string newName;
     fromStream >> newName;
-    m_annotations.push_back(newName);
+    m_annotations.emplace_back(newName);
   }
 
   return true;
@@ -0,0 +1,297 @@
+#include "CxxParse/Clang.hpp"
+
+#include <utility>
+
+ClangString::ClangString()
+{
+}
+
+ClangString::ClangString(CXString string)
+    : m_string(string), m_owned(true)
+{
+}
+
+ClangString::~ClangString()
+{
+  if (m_owned)
+  {
+    clang_disposeString(m_string);
+  }
+}
+
+ClangString::ClangString(ClangString &&other) noexcept
+    : m_string(other.m_string), m_owned(other.m_owned)
+{
+  other.m_owned = false;
+}
+
+ClangString &ClangString::operator=(ClangString &&other) noexcept
+{
+  std::swap(m_string, other.m_string);
+  std::swap(m_owned, other.m_owned);
+  return *this;
+}
+
+std::string_view ClangString::view() const
+{
+  char const *string = m_owned ? clang_getCString(m_string) : nullptr;
+  return string ? std::string_view(string) : std::string_view();
+}
+
+bool ClangString::isNull() const
+{
+  return !m_owned || clang_getCString(m_string) == nullptr;
+}
+
+ClangCursor::ClangCursor()
+    : m_cursor(clang_getNullCursor())
+{
+}
+
+ClangCursor::ClangCursor(CXCursor cursor)
+    : m_cursor(cursor)
+{
+}
+
+bool ClangCursor::isNull() const
+{
+  return clang_Cursor_isNull(m_cursor) != 0;
+}
+
+CXCursorKind ClangCursor::kind() const
+{
+  return clang_getCursorKind(m_cursor);
+}
+
+ClangString ClangCursor::spelling() const
+{
+  return ClangString(clang_getCursorSpelling(m_cursor));
+}
+
+ClangString ClangCursor::displayName() const
+{
+  return ClangString(clang_getCursorDisplayName(m_cursor));
+}
+
+ClangCursor ClangCursor::semanticParent() const
+{
+  return clang_getCursorSemanticParent(m_cursor);
+}
+
+ClangCursor ClangCursor::lexicalParent() const
+{
+  return clang_getCursorLexicalParent(m_cursor);
+}
+
+ClangCursor ClangCursor::definition() const
+{
+  return clang_getCursorDefinition(m_cursor);
+}
+
+ClangCursor ClangCursor::canonical() const
+{
+  return clang_getCanonicalCursor(m_cursor);
+}
+
+CXSourceLocation ClangCursor::location() const
+{
+  return clang_getCursorLocation(m_cursor);
+}
+
+CXSourceRange ClangCursor::extent() const
+{
+  return clang_getCursorExtent(m_cursor);
+}
+
+CXFile ClangCursor::file() const
+{
+  CXFile file = nullptr;
+  clang_getExpansionLocation(location(), &file, nullptr, nullptr, nullptr);
+  return file;
+}
+
+void ClangCursor::visitChildren(CXCursorVisitor visitor, CXClientData clientData) const
+{
+  clang_visitChildren(m_cursor, visitor, clientData);
+}
+
+bool ClangCursor::operator==(ClangCursor const &other) const
+{
+  return clang_equalCursors(m_cursor, other.m_cursor) != 0;
+}
+
+bool ClangCursor::operator!=(ClangCursor const &other) const
+{
+  return !(*this == other);
+}
+
+ClangDiagnostic::ClangDiagnostic(CXDiagnostic diagnostic)
+    : m_diagnostic(diagnostic)
+{
+}
+
+ClangDiagnostic::~ClangDiagnostic()
+{
+  if (m_diagnostic)
+  {
+    clang_disposeDiagnostic(m_diagnostic);
+  }
+}
+
+ClangDiagnostic::ClangDiagnostic(ClangDiagnostic &&other) noexcept
+    : m_diagnostic(other.m_diagnostic)
+{
+  other.m_diagnostic = nullptr;
+}
+
+ClangDiagnostic &ClangDiagnostic::operator=(ClangDiagnostic &&other) noexcept
+{
+  std::swap(m_diagnostic, other.m_diagnostic);
+  return *this;
+}
+
+CXDiagnosticSeverity ClangDiagnostic::severity() const
+{
+  return clang_getDiagnosticSeverity(m_diagnostic);
+}
+
+ClangString ClangDiagnostic::spelling() const
+{
+  return ClangString(clang_getDiagnosticSpelling(m_diagnostic));
+}
+
+ClangString ClangDiagnostic::format() const
+{
+  return ClangString(clang_formatDiagnostic(m_diagnostic, clang_defaultDiagnosticDisplayOptions()));
+}
+
+void ClangDiagnostic::location(CXFile &outFile, uint32_t &outLine, uint32_t &outColumn) const
+{
+  outFile = nullptr;
+  clang_getExpansionLocation(clang_getDiagnosticLocation(m_diagnostic), &outFile, &outLine, &outColumn, nullptr);
+}
+
+ClangTranslationUnit::ClangTranslationUnit()
+{
+}
+
+ClangTranslationUnit::~ClangTranslationUnit()
+{
+  reset();
+}
+
+ClangTranslationUnit::ClangTranslationUnit(ClangTranslationUnit &&other) noexcept
+    : m_translationUnit(other.m_translationUnit)
+{
+  other.m_translationUnit = nullptr;
+}
+
+ClangTranslationUnit &ClangTranslationUnit::operator=(ClangTranslationUnit &&other) noexcept
+{
+  std::swap(m_translationUnit, other.m_translationUnit);
+  return *this;
+}
+
+CXTranslationUnit *ClangTranslationUnit::reset()
+{
+  if (m_translationUnit)
+  {
+    clang_disposeTranslationUnit(m_translationUnit);
+    m_translationUnit = nullptr;
+  }
+
+  return &m_translationUnit;
+}
+
+ClangCursor ClangTranslationUnit::cursor() const
+{
+  return clang_getTranslationUnitCursor(m_translationUnit);
+}
+
+uint32_t ClangTranslationUnit::getNumDiagnostics() const
+{
+  return clang_getNumDiagnostics(m_translationUnit);
+}
+
+ClangDiagnostic ClangTranslationUnit::getDiagnostic(uint32_t index) const
+{
+  return ClangDiagnostic(clang_getDiagnostic(m_translationUnit, index));
+}
+
+bool ClangTranslationUnit::save(std::string const &path) const
+{
+  return clang_saveTranslationUnit(m_translationUnit, path.c_str(), clang_defaultSaveOptions(m_translationUnit)) == CXSaveError_None;
+}
+
+ClangTokens::ClangTokens(CXTranslationUnit translationUnit, CXSourceRange range)
+    : m_translationUnit(translationUnit)
+{
+  clang_tokenize(translationUnit, range, &m_tokens, &m_numTokens);
+}
+
+ClangTokens::~ClangTokens()
+{
+  if (m_tokens)
+  {
+    clang_disposeTokens(m_translationUnit, m_tokens, m_numTokens);
+  }
+}
+
+ClangString ClangTokens::spelling(uint32_t index) const
+{
+  return ClangString(clang_getTokenSpelling(m_translationUnit, m_tokens[index]));
+}
+
+ClangIndex::ClangIndex()
+{
+}
+
+ClangIndex::~ClangIndex()
+{
+  if (m_index)
+  {
+    clang_disposeIndex(m_index);
+  }
+}
+
+CXIndex ClangIndex::get()
+{
+  if (!m_index)
+  {
+    m_index = clang_createIndex(0, 0);
+  }
+
+  return m_index;
+}
+
+ClangIndexAction::ClangIndexAction()
+{
+}
+
+ClangIndexAction::~ClangIndexAction()
+{
+  if (m_action)
+  {
+    clang_IndexAction_dispose(m_action);
+  }
+}
+
+CXIndexAction ClangIndexAction::get(CXIndex index)
+{
+  if (!m_action)
+  {
+    m_action = clang_IndexAction_create(index);
+  }
+
+  return m_action;
+}
+
+ClangString getClangFileName(CXFile file)
+{
+  if (!file)
+  {
+    return ClangString();
+  }
+
+  return ClangString(clang_getFileName(file));
+}
@@ -0,0 +1,410 @@
+#include "CxxParse/ClangLibrary.hpp"
+#include "FileHashCache.hpp"
+
+// The forwarding functions below are defined under the names libclang exports, and must never be visible outside of
+// the generator. A host that embeds the library and links libclang itself would otherwise have its calls bound to
+// them, or ours bound to its libclang. Declared hidden here, so the definitions are hidden too. The C library headers
+// the API pulls in come first, they must keep their default visibility.
+#include <cstddef>
+#include <ctime>
+#ifndef _WIN32
+#pragma GCC visibility push(hidden)
+#endif
+#include <clang-c/Index.h>
+#ifndef _WIN32
+#pragma GCC visibility pop
+#endif
+
+#include <WIR/String.hpp>
+
+#include <cstdlib>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#ifndef WIR_LIBCLANG_PATH
+#define WIR_LIBCLANG_PATH "libclang.so"
+#endif
+
+std::string getClangLibraryPath()
+{
+  char const *overridePath = std::getenv("WIR_LIBCLANG");
+  if (overridePath && overridePath[0] != '\0')
+  {
+    return overridePath;
+  }
+
+  return WIR_LIBCLANG_PATH;
+}
+
+bool getClangLibraryIdentity(std::string &outIdentity)
+{
+#ifdef _WIN32
+  return false;
+#else
+  std::string path = getClangLibraryPath();
+  if (path.find('/') == std::string::npos)
+  {
+    return false;
+  }
+
+  // Follows the symlinks, so replacing the library behind libclang.so changes the identity
+  uint64_t size = 0;
+  uint64_t modified = 0;
+  if (!statFile(path, size, modified))
+  {
+    return false;
+  }
+
+  outIdentity = wir::format("%s;%llu;%llu", path.c_str(), (unsigned long long)size, (unsigned long long)modified);
+  return true;
+#endif
+}
+
+#ifndef _WIN32
+
+namespace
+{
+  void *openClangLibrary()
+  {
+    std::string path = getClangLibraryPath();
+    void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+    {
+      char const *error = dlerror();
+      throw std::runtime_error(wir::format("Could not load libclang from %s: %s", path.c_str(), error ? error : "unknown error"));
+    }
+
+    return library;
+  }
+
+  void *getClangSymbol(char const *name)
+  {
+    // Never closed, units and strings handed out by the library may live until exit
+    static void *library = openClangLibrary();
+
+    void *symbol = dlsym(library, name);
+    if (!symbol)
+    {
+      throw std::runtime_error(wir::format("libclang at %s has no %s, it is too old", getClangLibraryPath().c_str(), name));
+    }
+
+    return symbol;
+  }
+}
+
+// Resolved once per function on its first call, every call after that is a plain indirect call
+#define WIR_CLANG_FORWARD(name) static auto const forward = (decltype(&::name))getClangSymbol(#name)
+
+extern "C"
+{
+  unsigned clang_CXXMethod_isPureVirtual(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_CXXMethod_isPureVirtual);
+    return forward(C);
+  }
+
+  unsigned clang_CXXRecord_isAbstract(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_CXXRecord_isAbstract);
+    return forward(C);
+  }
+
+  int clang_Cursor_isNull(CXCursor cursor)
+  {
+    WIR_CLANG_FORWARD(clang_Cursor_isNull);
+    return forward(cursor);
+  }
+
+  CXIndexAction clang_IndexAction_create(CXIndex CIdx)
+  {
+    WIR_CLANG_FORWARD(clang_IndexAction_create);
+    return forward(CIdx);
+  }
+
+  void clang_IndexAction_dispose(CXIndexAction action)
+  {
+    WIR_CLANG_FORWARD(clang_IndexAction_dispose);
+    forward(action);
+  }
+
+  int clang_Location_isInSystemHeader(CXSourceLocation location)
+  {
+    WIR_CLANG_FORWARD(clang_Location_isInSystemHeader);
+    return forward(location);
+  }
+
+  CXIndex clang_createIndex(int excludeDeclarationsFromPCH, int displayDiagnostics)
+  {
+    WIR_CLANG_FORWARD(clang_createIndex);
+    return forward(excludeDeclarationsFromPCH, displayDiagnostics);
+  }
+
+  unsigned clang_defaultDiagnosticDisplayOptions(void)
+  {
+    WIR_CLANG_FORWARD(clang_defaultDiagnosticDisplayOptions);
+    return forward();
+  }
+
+  unsigned clang_defaultReparseOptions(CXTranslationUnit TU)
+  {
+    WIR_CLANG_FORWARD(clang_defaultReparseOptions);
+    return forward(TU);
+  }
+
+  unsigned clang_defaultSaveOptions(CXTranslationUnit TU)
+  {
+    WIR_CLANG_FORWARD(clang_defaultSaveOptions);
+    return forward(TU);
+  }
+
+  void clang_disposeDiagnostic(CXDiagnostic Diagnostic)
+  {
+    WIR_CLANG_FORWARD(clang_disposeDiagnostic);
+    forward(Diagnostic);
+  }
+
+  void clang_disposeIndex(CXIndex index)
+  {
+    WIR_CLANG_FORWARD(clang_disposeIndex);
+    forward(index);
+  }
+
+  void clang_disposeString(CXString string)
+  {
+    WIR_CLANG_FORWARD(clang_disposeString);
+    forward(string);
+  }
+
+  void clang_disposeTokens(CXTranslationUnit TU, CXToken *Tokens, unsigned NumTokens)
+  {
+    WIR_CLANG_FORWARD(clang_disposeTokens);
+    forward(TU, Tokens, NumTokens);
+  }
+
+  void clang_disposeTranslationUnit(CXTranslationUnit TU)
+  {
+    WIR_CLANG_FORWARD(clang_disposeTranslationUnit);
+    forward(TU);
+  }
+
+  unsigned clang_equalCursors(CXCursor A, CXCursor B)
+  {
+    WIR_CLANG_FORWARD(clang_equalCursors);
+    return forward(A, B);
+  }
+
+  CXString clang_formatDiagnostic(CXDiagnostic Diagnostic, unsigned Options)
+  {
+    WIR_CLANG_FORWARD(clang_formatDiagnostic);
+    return forward(Diagnostic, Options);
+  }
+
+  const char *clang_getCString(CXString string)
+  {
+    WIR_CLANG_FORWARD(clang_getCString);
+    return forward(string);
+  }
+
+  enum CX_CXXAccessSpecifier clang_getCXXAccessSpecifier(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCXXAccessSpecifier);
+    return forward(C);
+  }
+
+  CXCursor clang_getCanonicalCursor(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCanonicalCursor);
+    return forward(C);
+  }
+
+  CXType clang_getCanonicalType(CXType T)
+  {
+    WIR_CLANG_FORWARD(clang_getCanonicalType);
+    return forward(T);
+  }
+
+  CXString clang_getClangVersion(void)
+  {
+    WIR_CLANG_FORWARD(clang_getClangVersion);
+    return forward();
+  }
+
+  CXCursor clang_getCursorDefinition(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorDefinition);
+    return forward(C);
+  }
+
+  CXString clang_getCursorDisplayName(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorDisplayName);
+    return forward(C);
+  }
+
+  CXSourceRange clang_getCursorExtent(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorExtent);
+    return forward(C);
+  }
+
+  enum CXCursorKind clang_getCursorKind(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorKind);
+    return forward(C);
+  }
+
+  CXCursor clang_getCursorLexicalParent(CXCursor cursor)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorLexicalParent);
+    return forward(cursor);
+  }
+
+  CXSourceLocation clang_getCursorLocation(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorLocation);
+    return forward(C);
+  }
+
+  CXCursor clang_getCursorSemanticParent(CXCursor cursor)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorSemanticParent);
+    return forward(cursor);
+  }
+
+  CXString clang_getCursorSpelling(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorSpelling);
+    return forward(C);
+  }
+
+  CXType clang_getCursorType(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getCursorType);
+    return forward(C);
+  }
+
+  CXDiagnostic clang_getDiagnostic(CXTranslationUnit Unit, unsigned Index)
+  {
+    WIR_CLANG_FORWARD(clang_getDiagnostic);
+    return forward(Unit, Index);
+  }
+
+  CXSourceLocation clang_getDiagnosticLocation(CXDiagnostic Diagnostic)
+  {
+    WIR_CLANG_FORWARD(clang_getDiagnosticLocation);
+    return forward(Diagnostic);
+  }
+
+  enum CXDiagnosticSeverity clang_getDiagnosticSeverity(CXDiagnostic Diagnostic)
+  {
+    WIR_CLANG_FORWARD(clang_getDiagnosticSeverity);
+    return forward(Diagnostic);
+  }
+
+  CXString clang_getDiagnosticSpelling(CXDiagnostic Diagnostic)
+  {
+    WIR_CLANG_FORWARD(clang_getDiagnosticSpelling);
+    return forward(Diagnostic);
+  }
+
+  long long clang_getEnumConstantDeclValue(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_getEnumConstantDeclValue);
+    return forward(C);
+  }
+
+  void clang_getExpansionLocation(CXSourceLocation location, CXFile *file, unsigned *line, unsigned *column, unsigned *offset)
+  {
+    WIR_CLANG_FORWARD(clang_getExpansionLocation);
+    forward(location, file, line, column, offset);
+  }
+
+  CXString clang_getFileName(CXFile SFile)
+  {
+    WIR_CLANG_FORWARD(clang_getFileName);
+    return forward(SFile);
+  }
+
+  void clang_getInclusions(CXTranslationUnit tu, CXInclusionVisitor visitor, CXClientData client_data)
+  {
+    WIR_CLANG_FORWARD(clang_getInclusions);
+    forward(tu, visitor, client_data);
+  }
+
+  CXCursor clang_getNullCursor(void)
+  {
+    WIR_CLANG_FORWARD(clang_getNullCursor);
+    return forward();
+  }
+
+  unsigned clang_getNumDiagnostics(CXTranslationUnit Unit)
+  {
+    WIR_CLANG_FORWARD(clang_getNumDiagnostics);
+    return forward(Unit);
+  }
+
+  CXString clang_getTokenSpelling(CXTranslationUnit TU, CXToken Token)
+  {
+    WIR_CLANG_FORWARD(clang_getTokenSpelling);
+    return forward(TU, Token);
+  }
+
+  CXCursor clang_getTranslationUnitCursor(CXTranslationUnit TU)
+  {
+    WIR_CLANG_FORWARD(clang_getTranslationUnitCursor);
+    return forward(TU);
+  }
+
+  CXCursor clang_getTypeDeclaration(CXType T)
+  {
+    WIR_CLANG_FORWARD(clang_getTypeDeclaration);
+    return forward(T);
+  }
+
+  unsigned clang_hashCursor(CXCursor C)
+  {
+    WIR_CLANG_FORWARD(clang_hashCursor);
+    return forward(C);
+  }
+
+  int clang_indexSourceFile(CXIndexAction action, CXClientData client_data, IndexerCallbacks *index_callbacks, unsigned index_callbacks_size, unsigned index_options, const char *source_filename, const char *const *command_line_args, int num_command_line_args, struct CXUnsavedFile *unsaved_files, unsigned num_unsaved_files, CXTranslationUnit *out_TU, unsigned TU_options)
+  {
+    WIR_CLANG_FORWARD(clang_indexSourceFile);
+    return forward(action, client_data, index_callbacks, index_callbacks_size, index_options, source_filename, command_line_args, num_command_line_args, unsaved_files, num_unsaved_files, out_TU, TU_options);
+  }
+
+  enum CXErrorCode clang_parseTranslationUnit2(CXIndex CIdx, const char *source_filename, const char *const *command_line_args, int num_command_line_args, struct CXUnsavedFile *unsaved_files, unsigned num_unsaved_files, unsigned options, CXTranslationUnit *out_TU)
+  {
+    WIR_CLANG_FORWARD(clang_parseTranslationUnit2);
+    return forward(CIdx, source_filename, command_line_args, num_command_line_args, unsaved_files, num_unsaved_files, options, out_TU);
+  }
+
+  int clang_reparseTranslationUnit(CXTranslationUnit TU, unsigned num_unsaved_files, struct CXUnsavedFile *unsaved_files, unsigned options)
+  {
+    WIR_CLANG_FORWARD(clang_reparseTranslationUnit);
+    return forward(TU, num_unsaved_files, unsaved_files, options);
+  }
+
+  int clang_saveTranslationUnit(CXTranslationUnit TU, const char *FileName, unsigned options)
+  {
+    WIR_CLANG_FORWARD(clang_saveTranslationUnit);
+    return forward(TU, FileName, options);
+  }
+
+  void clang_tokenize(CXTranslationUnit TU, CXSourceRange Range, CXToken **Tokens, unsigned *NumTokens)
+  {
+    WIR_CLANG_FORWARD(clang_tokenize);
+    forward(TU, Range, Tokens, NumTokens);
+  }
+
+  unsigned clang_visitChildren(CXCursor parent, CXCursorVisitor visitor, CXClientData client_data)
+  {
+    WIR_CLANG_FORWARD(clang_visitChildren);
+    return forward(parent, visitor, client_data);
+  }
+}
+
+#endif
@@ -1,53 +1,54 @@
 
 #include "CxxParse/ClassDeclaration.hpp"
+#include "SerializableFile.hpp"
 
-bool ClassDeclaration::isAbstract()
+bool ClassDeclaration::isAbstract() const
 {
   return m_abstract;
 }
 
-std::string const &ClassDeclaration::getName()
+std::string const &ClassDeclaration::getName() const
 {
-  return m_name;
+  return *m_name;
 }
 
-void ClassDeclaration::setName(std::string const &newValue)
+void ClassDeclaration::setName(std::string_view newValue)
 {
-  m_name = newValue;
+  m_name = &m_symbols->intern(newValue);
+  m_qualifiedName = &m_symbols->intern(m_namespace, newValue);
 }
 
-std::vector<MethodDeclaration> const &ClassDeclaration::getMethodDeclarations()
+std::span<MethodDeclaration const> ClassDeclaration::getMethodDeclarations() const
 {
   return m_methodDeclarations;
 }
 
-std::vector<std::string> const &ClassDeclaration::getBaseClasses()
+std::span<std::pmr::string const> ClassDeclaration::getBaseClasses() const
 {
   return m_baseClasses;
 }
 
 bool ClassDeclaration::serialize(wir::Stream &toStream) const
 {
-  toStream << m_name;
+  toStream << *m_name;
 
-  auto ns = m_namespace;
+  auto ns = m_symbols->getPath(m_namespace);
   toStream << (uint32_t)ns.size();
-  while (!ns.empty())
+  for (auto const &name : ns)
   {
-    toStream << ns.top();
-    ns.pop();
+    toStream << name;
   }
 
   toStream << (uint64_t)m_methodDeclarations.size();
-  for (auto m : m_methodDeclarations)
+  for (auto const &m : m_methodDeclarations)
   {
     toStream << m;
   }
 
   toStream << (uint64_t)m_baseClasses.size();
-  for (auto s : m_baseClasses)
+  for (auto const &base : m_baseClasses)
   {
-    toStream << s;
+    toStream << std::string(base);
   }
 
   toStream << m_abstract;
@@ -62,36 +63,37 @@ bool ClassDeclaration::serialize(wir::Stream &toStream) const
 
 bool ClassDeclaration::deserialize(wir::Stream &fromStream)
 {
-  fromStream >> m_name;
+  std::string name;
+  fromStream >> name;
 
-  m_namespace = std::stack<std::string>();
-  uint32_t nsLen = 0;
-  fromStream >> nsLen;
+  std::vector<std::string> ns;
+  uint32_t nsLen = readCount<uint32_t>(fromStream);
   for (uint32_t i = 0; i < nsLen; i++)
   {
-    std::string ns;
-    fromStream >> ns;
-    m_namespace.push(ns);
+    std::string newNs;
+    fromStream >> newNs;
+    ns.push_back(newNs);
   }
 
+  m_namespace = m_symbols->getNamespace(ns);
+  setName(name);
+
   m_methodDeclarations.clear();
-  uint64_t numMethods = 0;
-  fromStream >> numMethods;
+  uint64_t numMethods = readCount(fromStream);
+  m_methodDeclarations.reserve(numMethods);
   for (uint64_t i = 0; i < numMethods; i++)
   {
-    MethodDeclaration newDecl;
-    fromStream >> newDecl;
-    m_methodDeclarations.push_back(newDecl);
+    fromStream >> m_methodDeclarations.emplace_back();
   }
 
   m_baseClasses.clear();
-  uint64_t numBases = 0;
-  fromStream >> numBases;
+  uint64_t numBases = readCount(fromStream);
+  m_baseClasses.reserve(numBases);
   for (uint64_t i = 0; i < numBases; i++)
   {
     std::string newBase;
     fromStream >> newBase;
-    m_baseClasses.push_back(newBase);
+    addBaseClass(newBase);
   }
 
   fromStream >> m_abstract;
@@ -106,7 +108,7 @@ bool ClassDeclaration::deserialize(wir::Stream &fromStream)
 
 bool MethodDeclaration::serialize(wir::Stream &toStream) const
 {
-  toStream << m_name;
+  toStream << std::string(m_name);
   toStream << (uint8_t)m_accessSpecifier;
   toStream << m_isPureVirtual;
 
@@ -120,7 +122,10 @@ bool MethodDeclaration::serialize(wir::Stream &toStream) const
 
 bool MethodDeclaration::deserialize(wir::Stream &fromStream)
 {
-  fromStream >> m_name;
+  std::string name;
+  fromStream >> name;
+  setName(name);
+
   uint8_t _as = 0;
   fromStream >> _as;
   m_accessSpecifier = (AccessSpecifier)_as;
@@ -134,53 +139,49 @@ bool MethodDeclaration::deserialize(wir::Stream &fromStream)
   return true;
 }
 
-void ClassDeclaration::addBaseClass(const std::string &newBase)
+void ClassDeclaration::addBaseClass(std::string_view newBase)
 {
-  m_baseClasses.push_back(newBase);
+  m_baseClasses.emplace_back(newBase);
 }
 
-std::stack<std::string> ClassDeclaration::getNamespace() const
+NamespaceId ClassDeclaration::getNamespace() const
 {
   return m_namespace;
 }
 
-std::string ClassDeclaration::getFullyQualifiedName() const
+std::string const &ClassDeclaration::getFullyQualifiedName() const
 {
-  std::string fqn;
-  auto ns = m_namespace;
-  while (!ns.empty())
-  {
-    fqn += ns.top() + "::";
-    ns.pop();
-  }
-
-  fqn += m_name;
-
-  return fqn;
+  return *m_qualifiedName;
 }
 
-void ClassDeclaration::addMethodDeclaration(const MethodDeclaration &newDeclaration)
+MethodDeclaration &ClassDeclaration::addMethodDeclaration(std::string_view name, AccessSpecifier accessSpec, bool pureVirtual)
 {
-  m_methodDeclarations.push_back(newDeclaration);
+  return m_methodDeclarations.emplace_back(name, accessSpec, pureVirtual);
 }
 
-MethodDeclaration::MethodDeclaration()
+MethodDeclaration::MethodDeclaration(allocator_type const &allocator)
+    : AnnotatedSymbol(allocator), m_name(allocator)
 {
 }
 
-MethodDeclaration::MethodDeclaration(const std::string &name, AccessSpecifier accessSpec, bool pureVirtual)
+MethodDeclaration::MethodDeclaration(std::string_view name, AccessSpecifier accessSpec, bool pureVirtual, allocator_type const &allocator)
+    : AnnotatedSymbol(allocator), m_name(name, allocator)
 {
-  m_name = name;
   m_accessSpecifier = accessSpec;
   m_isPureVirtual = pureVirtual;
 }
 
-std::string const &MethodDeclaration::getName() const
+MethodDeclaration::MethodDeclaration(MethodDeclaration &&other, allocator_type const &allocator)
+    : AnnotatedSymbol(std::move(other), allocator), m_name(std::move(other.m_name), allocator), m_accessSpecifier(other.m_accessSpecifier), m_isPureVirtual(other.m_isPureVirtual)
+{
+}
+
+std::string_view MethodDeclaration::getName() const
 {
   return m_name;
 }
 
-void MethodDeclaration::setName(std::string const &newValue)
+void MethodDeclaration::setName(std::string_view newValue)
 {
   m_name = newValue;
 }
@@ -205,13 +206,28 @@ void MethodDeclaration::setPureVirtual(bool newValue)
   m_isPureVirtual = newValue;
 }
 
-ClassDeclaration::ClassDeclaration()
+ClassDeclaration::ClassDeclaration(SymbolTable &symbols, allocator_type const &allocator)
+    : AnnotatedSymbol(allocator), m_symbols(&symbols), m_methodDeclarations(allocator), m_baseClasses(allocator)
 {
+  setName("");
 }
 
-ClassDeclaration::ClassDeclaration(const std::string &newName, std::stack<std::string> ns, bool abs)
+ClassDeclaration::ClassDeclaration(SymbolTable &symbols, std::string_view newName, NamespaceId ns, bool abs, allocator_type const &allocator)
+    : AnnotatedSymbol(allocator), m_symbols(&symbols), m_methodDeclarations(allocator), m_baseClasses(allocator)
 {
-  m_name = newName;
   m_namespace = ns;
   m_abstract = abs;
+  setName(newName);
+}
+
+ClassDeclaration::ClassDeclaration(ClassDeclaration &&other, allocator_type const &allocator)
+    : AnnotatedSymbol(std::move(other), allocator),
+      m_symbols(other.m_symbols),
+      m_name(other.m_name),
+      m_qualifiedName(other.m_qualifiedName),
+      m_namespace(other.m_namespace),
+      m_methodDeclarations(std::move(other.m_methodDeclarations), allocator),
+      m_baseClasses(std::move(other.m_baseClasses), allocator),
+      m_abstract(other.m_abstract)
+{
 }
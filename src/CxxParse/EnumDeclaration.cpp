@@ -1,53 +1,87 @@
 
 #include "CxxParse/EnumDeclaration.hpp"
+#include "SerializableFile.hpp"
 
-EnumDeclaration::EnumDeclaration()
+#include <algorithm>
+
+EnumVariable::EnumVariable(std::string_view inName, int64_t inValue, allocator_type const &allocator)
+    : name(inName, allocator), value(inValue)
+{
+}
+
+EnumVariable::EnumVariable(EnumVariable &&other, allocator_type const &allocator)
+    : name(std::move(other.name), allocator), value(other.value)
+{
+}
+
+EnumDeclaration::EnumDeclaration(SymbolTable &symbols, allocator_type const &allocator)
+    : AnnotatedSymbol(allocator), m_symbols(&symbols), m_variables(allocator)
 {
+  setName("");
 }
 
-EnumDeclaration::EnumDeclaration(const std::string &name, std::stack<std::string> ns)
+EnumDeclaration::EnumDeclaration(SymbolTable &symbols, std::string_view name, NamespaceId ns, allocator_type const &allocator)
+    : AnnotatedSymbol(allocator), m_symbols(&symbols), m_variables(allocator)
 {
-  m_name = name;
   m_namespace = ns;
+  setName(name);
+}
+
+EnumDeclaration::EnumDeclaration(EnumDeclaration &&other, allocator_type const &allocator)
+    : AnnotatedSymbol(std::move(other), allocator),
+      m_symbols(other.m_symbols),
+      m_name(other.m_name),
+      m_qualifiedName(other.m_qualifiedName),
+      m_namespace(other.m_namespace),
+      m_variables(std::move(other.m_variables), allocator)
+{
 }
 
-std::string const &EnumDeclaration::getName()
+std::string const &EnumDeclaration::getName() const
 {
-  return m_name;
+  return *m_name;
 }
 
-void EnumDeclaration::setName(std::string const &newName)
+void EnumDeclaration::setName(std::string_view newName)
 {
-  m_name = newName;
+  m_name = &m_symbols->intern(newName);
+  m_qualifiedName = &m_symbols->intern(m_namespace, newName);
 }
 
-std::map<std::string, int64_t> const &EnumDeclaration::getVariables()
+std::span<EnumVariable const> EnumDeclaration::getVariables() const
 {
   return m_variables;
 }
 
-void EnumDeclaration::addVariable(const std::string &variableName, int64_t value)
+void EnumDeclaration::addVariable(std::string_view variableName, int64_t value)
 {
-  m_variables[variableName] = value;
+  // Kept sorted by name, which is also the order they are serialized in
+  auto position = std::lower_bound(m_variables.begin(), m_variables.end(), variableName, [](EnumVariable const &variable, std::string_view name) { return variable.name < name; });
+  if (position != m_variables.end() && position->name == variableName)
+  {
+    position->value = value;
+    return;
+  }
+
+  m_variables.emplace(position, variableName, value);
 }
 
 bool EnumDeclaration::serialize(wir::Stream &toStream) const
 {
-  toStream << m_name;
+  toStream << *m_name;
 
-  auto ns = m_namespace;
+  auto ns = m_symbols->getPath(m_namespace);
   toStream << (uint32_t)ns.size();
-  while (!ns.empty())
+  for (auto const &name : ns)
   {
-    toStream << ns.top();
-    ns.pop();
+    toStream << name;
   }
 
   toStream << (uint64_t)m_variables.size();
-  for (auto v : m_variables)
+  for (auto const &v : m_variables)
   {
-    toStream << v.first;
-    toStream << v.second;
+    toStream << std::string(v.name);
+    toStream << v.value;
   }
 
   if (!AnnotatedSymbol::serialize(toStream))
@@ -60,21 +94,24 @@ bool EnumDeclaration::serialize(wir::Stream &toStream) const
 
 bool EnumDeclaration::deserialize(wir::Stream &fromStream)
 {
-  fromStream >> m_name;
+  std::string name;
+  fromStream >> name;
 
-  m_namespace = std::stack<std::string>();
-  uint32_t nsLen = 0;
-  fromStream >> nsLen;
+  std::vector<std::string> ns;
+  uint32_t nsLen = readCount<uint32_t>(fromStream);
   for (uint32_t i = 0; i < nsLen; i++)
   {
-    std::string ns;
-    fromStream >> ns;
-    m_namespace.push(ns);
+    std::string newNs;
+    fromStream >> newNs;
+    ns.push_back(newNs);
   }
 
+  m_namespace = m_symbols->getNamespace(ns);
+  setName(name);
+
   m_variables.clear();
-  uint64_t numValues = 0;
-  fromStream >> numValues;
+  uint64_t numValues = readCount(fromStream);
+  m_variables.reserve(numValues);
   for (uint64_t i = 0; i < numValues; i++)
   {
     std::string newName;
@@ -83,7 +120,7 @@ bool EnumDeclaration::deserialize(wir::Stream &fromStream)
     int64_t newValue = 0;
     fromStream >> newValue;
 
-    m_variables[newName] = newValue;
+    addVariable(newName, newValue);
   }
 
   if (!AnnotatedSymbol::deserialize(fromStream))
@@ -94,17 +131,7 @@ bool EnumDeclaration::deserialize(wir::Stream &fromStream)
   return true;
 }
 
-std::string EnumDeclaration::getFullyQualifiedName() const
+std::string const &EnumDeclaration::getFullyQualifiedName() const
 {
-  std::string fqn;
-  auto ns = m_namespace;
-  while (!ns.empty())
-  {
-    fqn += ns.top() + "::";
-    ns.pop();
-  }
-
-  fqn += m_name;
-
-  return fqn;
-}
\ No newline at end of file
+  return *m_qualifiedName;
+}
@@ -1,115 +1,162 @@
 
 #include "CxxParse/HeaderFile.hpp"
+#include "CxxParse/Clang.hpp"
+#include "CxxParse/ClangLibrary.hpp"
 #include "CxxParse/EnumDeclaration.hpp"
+#include "CxxParse/PrecompiledPreamble.hpp"
+#include "CxxParse/TranslationUnitPool.hpp"
+#include "CxxParse/WorkerIndex.hpp"
+#include "SerializableFile.hpp"
 
 #include <WIR/Error.hpp>
 #include <WIR/Filesystem.hpp>
 #include <WIR/Stream.hpp>
+#include <WIR/String.hpp>
 
+#include <algorithm>
 #include <clang-c/Index.h>
 #include <fstream>
 #include <iostream>
 #include <sstream>
-#include <stack>
+#include <unordered_map>
 
-static std::string getCursorLocationPath(CXCursor &cursor)
+struct _CursorHash
 {
-  CXSourceLocation loc = clang_getCursorLocation(cursor);
-  CXFile file;
-  uint32_t lineno;
-  uint32_t colno;
-  uint32_t wutno;
-  clang_getExpansionLocation(loc, &file, &lineno, &colno, &wutno);
+  size_t operator()(CXCursor const &cursor) const
+  {
+    return clang_hashCursor(cursor);
+  }
+};
 
-  CXString filepathcl = clang_getFileName(file);
-  return wir::File(clang_getCString(filepathcl)).path();
-}
+struct _CursorEqual
+{
+  bool operator()(CXCursor const &a, CXCursor const &b) const
+  {
+    return clang_equalCursors(a, b) != 0;
+  }
+};
+
+struct _FileInfo
+{
+  // The header collecting the declarations in this file, if any
+  HeaderFile *target = nullptr;
+  bool isSystemHeader = false;
+};
 
 struct _VisitData
 {
+  // Collects the inheritance data of the whole translation unit
   HeaderFile *header = nullptr;
-  std::stack<std::string> ns;
+
+  // Headers whose declarations are collected, by path
+  std::map<std::string, HeaderFile *> targets;
+
+  // Shared by the header and every harvested header
+  SymbolTable *symbols = nullptr;
+
+  NamespaceId ns = SymbolTable::GlobalNamespace;
+  CXTranslationUnit translationUnit = nullptr;
+  bool singleFile = false;
+
+  // Canonical declarations mapped to their interned qualified names, shared prefixes are only resolved once
+  std::unordered_map<CXCursor, std::string const *, _CursorHash, _CursorEqual> qualifiedNames;
+
+  // Decided once per file, every declaration in it shares the same answer
+  std::unordered_map<CXFile, _FileInfo> files;
+
+  // Namespace cursors mapped to their namespace, or to nothing when declarations in them are not collected
+  std::unordered_map<CXCursor, std::pair<bool, NamespaceId>, _CursorHash, _CursorEqual> lexicalNamespaces;
 };
 
-static bool isForwardDeclaration(CXCursor cursor)
+/** What is known about the file the cursor is located in */
+static _FileInfo const &getFileInfo(ClangCursor cursor, _VisitData *visitData)
 {
-  auto definition = clang_getCursorDefinition(cursor);
+  CXFile file = cursor.file();
 
-  // If the definition is null, then there is no definition in this translation
-  // unit, so this cursor must be a forward declaration.
-  if (clang_equalCursors(definition, clang_getNullCursor()))
-    return true;
+  auto finder = visitData->files.find(file);
+  if (finder != visitData->files.end())
+  {
+    return finder->second;
+  }
 
-  // If there is a definition, then the forward declaration and the definition
-  // are in the same translation unit. This cursor is the forward declaration if
-  // it is _not_ the definition.
-  return !clang_equalCursors(cursor, definition);
-}
+  _FileInfo &info = visitData->files[file];
+  info.isSystemHeader = clang_Location_isInSystemHeader(cursor.location()) != 0;
 
-std::stack<std::string> getNamespaceFrom(CXCursor c)
-{
-  std::stack<std::string> ns;
-  CXCursor p = clang_getCursorSemanticParent(c);
-  while (!clang_Cursor_isNull(p) && clang_getCursorKind(p) != CXCursor_TranslationUnit)
+  ClangString filepath = getClangFileName(file);
+  if (!filepath.isNull())
   {
-    ns.push(clang_getCString(clang_getCursorSpelling(p)));
-    p = clang_getCursorSemanticParent(p);
+    auto targetFinder = visitData->targets.find(wir::File(filepath.str()).path());
+    info.target = targetFinder != visitData->targets.end() ? targetFinder->second : nullptr;
   }
 
-  return ns;
+  return info;
 }
 
-bool cleanFQNameFwdDecl(std::string cluttered, std::string &uncluttered)
+/** Whether a namespace can be left out entirely, the reserved namespaces of the system headers never lead to wir::Class */
+static bool isPrunedNamespace(ClangCursor cursor, std::string_view name, _VisitData *visitData)
 {
-  auto split = wir::split(wir::trim(cluttered), { ' ', '\t', '\n', '\r' });
-  if (split.size() != 1)
+  if (name != "std" && name.substr(0, 2) != "__")
   {
-    if (split.size() == 0)
-    {
-      LogError("Invalid classname: \"%s\"", cluttered.c_str());
-      return false;
-    }
-    else if (wir::trim(split[0]) == "struct" || wir::trim(split[0]) == "class")
-    {
-      uncluttered = wir::trim(wir::substring(cluttered, split[0].size()));
-      return true;
-    }
+    return false;
   }
-  return true;
+
+  return getFileInfo(cursor, visitData).isSystemHeader;
 }
 
-std::string getFQNameFrom(CXCursor c)
+struct _ClassVisitData
 {
-  std::string fq;
-  auto ns = getNamespaceFrom(c);
-  while (!ns.empty())
+  ClassDeclaration *classDecl = nullptr;
+  bool semanticBases = true;
+  _VisitData *visitData = nullptr;
+};
+
+/**
+ * The qualified name of a declaration. Redeclarations share their canonical cursor, which identifies the symbol
+ * within the translation unit, and every semantic parent on the way up is resolved once per translation unit.
+ */
+static std::string const &getQualifiedName(ClangCursor declaration, _VisitData *visitData)
+{
+  ClangCursor canonical = declaration.canonical();
+  auto finder = visitData->qualifiedNames.find(canonical.get());
+  if (finder != visitData->qualifiedNames.end())
   {
-    fq += ns.top() + "::";
-    ns.pop();
+    return *finder->second;
   }
 
-  fq += clang_getCString(clang_getCursorSpelling(c));
+  ClangString spelling = canonical.spelling();
 
-  // Handle forward declarations more gracefully
-  if (!cleanFQNameFwdDecl(fq, fq))
+  ClangCursor parent = canonical.semanticParent();
+  std::string const *qualifiedName = nullptr;
+  if (parent.isNull() || parent.kind() == CXCursor_TranslationUnit)
+  {
+    qualifiedName = &visitData->symbols->intern(spelling.view());
+  }
+  else
   {
-    LogError("Failed to clean possible forward declaration");
+    std::string name = getQualifiedName(parent, visitData);
+    name += "::";
+    name += spelling.view();
+    qualifiedName = &visitData->symbols->intern(name);
   }
 
-  return fq;
+  visitData->qualifiedNames.emplace(canonical.get(), qualifiedName);
+  return *qualifiedName;
+}
+
+/** The class a base specifier names, seen through typedefs and elaborations, null for dependent bases */
+static ClangCursor getBaseDeclaration(ClangCursor baseSpecifier)
+{
+  return clang_getTypeDeclaration(clang_getCanonicalType(clang_getCursorType(baseSpecifier.get())));
 }
 
 static CXChildVisitResult _kcgHeader_visitAnnotations(CXCursor cursor, CXCursor parent, CXClientData client_data)
 {
   AnnotatedSymbol *annotated = (AnnotatedSymbol *)client_data;
-  std::string name = clang_getCString(clang_getCursorSpelling(cursor));
-  std::string parentName = clang_getCString(clang_getCursorSpelling(parent));
-  CXCursorKind kind = clang_getCursorKind(cursor);
+  ClangCursor current(cursor);
 
-  if (kind == CXCursor_AnnotateAttr)
+  if (current.kind() == CXCursor_AnnotateAttr)
   {
-    std::string newAnnotation = clang_getCString(clang_getCursorDisplayName(cursor));
-    annotated->addAnnotation(newAnnotation);
+    annotated->addAnnotation(current.displayName().str());
   }
 
   return CXChildVisit_Continue;
@@ -118,37 +165,109 @@ static CXChildVisitResult _kcgHeader_visitAnnotations(CXCursor cursor, CXCursor
 static CXChildVisitResult _kcgHeader_visitEnumDecl(CXCursor cursor, CXCursor parent, CXClientData client_data)
 {
   EnumDeclaration *enumDecl = (EnumDeclaration *)client_data;
-  std::string name = clang_getCString(clang_getCursorSpelling(cursor));
-  CXCursorKind kind = clang_getCursorKind(cursor);
+  ClangCursor current(cursor);
 
-  if (kind == CXCursor_EnumConstantDecl)
+  if (current.kind() == CXCursor_EnumConstantDecl)
   {
-    enumDecl->addVariable(name, clang_getEnumConstantDeclValue(cursor));
+    enumDecl->addVariable(current.spelling().view(), clang_getEnumConstantDeclValue(cursor));
   }
 
   return CXChildVisit_Recurse;
 }
 
+/**
+ * Reads the base classes of a class definition from its tokens, exactly as written.
+ * Used when parsing without includes, where the bases are usually undeclared and missing from the AST.
+ */
+static std::vector<std::string> getWrittenBaseClasses(CXTranslationUnit translationUnit, ClangCursor cursor)
+{
+  std::vector<std::string> bases;
+
+  ClangTokens tokens(translationUnit, cursor.extent());
+
+  bool inBaseList = false;
+  int32_t depth = 0;
+  std::string currentBase;
+  for (uint32_t i = 0; i < tokens.size(); i++)
+  {
+    ClangString spellingcl = tokens.spelling(i);
+    std::string_view spelling = spellingcl.view();
+
+    if (spelling == "<" || spelling == "(")
+    {
+      depth++;
+      continue;
+    }
+    else if (spelling == ">" || spelling == ")")
+    {
+      depth--;
+      continue;
+    }
+    else if (spelling == ">>")
+    {
+      depth -= 2;
+      continue;
+    }
+
+    // Template arguments and attribute arguments are not part of the base name
+    if (depth > 0)
+    {
+      continue;
+    }
+
+    if (spelling == "{" || spelling == ";")
+    {
+      break;
+    }
+
+    if (!inBaseList)
+    {
+      inBaseList = spelling == ":";
+      continue;
+    }
+
+    if (spelling == ",")
+    {
+      if (!currentBase.empty())
+      {
+        bases.push_back(currentBase);
+      }
+      currentBase.clear();
+    }
+    else if (spelling != "public" && spelling != "protected" && spelling != "private" && spelling != "virtual" && spelling != "...")
+    {
+      currentBase += spelling;
+    }
+  }
+
+  if (inBaseList && !currentBase.empty())
+  {
+    bases.push_back(currentBase);
+  }
+
+  return bases;
+}
+
 static CXChildVisitResult _kcgHeader_visitClassDecl(CXCursor cursor, CXCursor parent, CXClientData client_data)
 {
-  ClassDeclaration *classDecl = (ClassDeclaration *)client_data;
-  std::string name = clang_getCString(clang_getCursorSpelling(cursor));
-  std::string parentName = clang_getCString(clang_getCursorSpelling(parent));
+  _ClassVisitData *classVisitData = (_ClassVisitData *)client_data;
+  ClassDeclaration *classDecl = classVisitData->classDecl;
   CXCursorKind kind = clang_getCursorKind(cursor);
 
-  if (kind == CXCursor_CXXBaseSpecifier)
+  if (kind == CXCursor_CXXBaseSpecifier && classVisitData->semanticBases)
   {
-    std::string className = getFQNameFrom(clang_getCursorDefinition(cursor));
-    classDecl->addBaseClass(className);
+    ClangCursor baseDeclaration = getBaseDeclaration(cursor);
+    if (!baseDeclaration.isNull())
+    {
+      classDecl->addBaseClass(getQualifiedName(baseDeclaration, classVisitData->visitData));
+    }
   }
   else if (kind == CXCursor_CXXMethod)
   {
     const static std::map<CX_CXXAccessSpecifier, AccessSpecifier> accessMap = {{CX_CXXPublic, AS_Public}, {CX_CXXProtected, AS_Protected}, {CX_CXXPrivate, AS_Private}, {CX_CXXInvalidAccessSpecifier, AS_Public}};
 
-    MethodDeclaration newMethod(clang_getCString(clang_getCursorSpelling(cursor)), accessMap.at(clang_getCXXAccessSpecifier(cursor)), clang_CXXMethod_isPureVirtual(cursor));
+    MethodDeclaration &newMethod = classDecl->addMethodDeclaration(ClangCursor(cursor).spelling().view(), accessMap.at(clang_getCXXAccessSpecifier(cursor)), clang_CXXMethod_isPureVirtual(cursor));
     clang_visitChildren(cursor, _kcgHeader_visitAnnotations, dynamic_cast<AnnotatedSymbol *>(&newMethod));
-
-    classDecl->addMethodDeclaration(newMethod);
   }
 
   return CXChildVisit_Continue;
@@ -162,91 +281,277 @@ static CXChildVisitResult _kcgHeader_visitClassDecl_onlyBases(CXCursor cursor, C
 
   if (kind == CXCursor_CXXBaseSpecifier)
   {
-    std::string className = clang_getCString(clang_getCursorSpelling(clang_getCursorDefinition(cursor)));
-
-    header->registerBaseClass(getFQNameFrom(parent), getFQNameFrom(cursor));
+    ClangCursor baseDeclaration = getBaseDeclaration(cursor);
+    if (!baseDeclaration.isNull())
+    {
+      header->registerBaseClass(getQualifiedName(parent, visitData), getQualifiedName(baseDeclaration, visitData));
+    }
   }
 
   return CXChildVisit_Continue;
 }
 
+/** Collects a class or enum declaration at namespace scope, visitData->ns has to hold the namespace it was declared in */
+static void _kcgHeader_visitDeclaration(ClangCursor cursor, _VisitData *visitData)
+{
+  CXCursorKind kind = cursor.kind();
+  bool isRecord = kind == CXCursor_ClassDecl || kind == CXCursor_StructDecl;
+  if (!isRecord && kind != CXCursor_EnumDecl)
+  {
+    return;
+  }
+
+  // Forward declarations contribute nothing, the definition is visited on its own
+  if (cursor != cursor.definition())
+  {
+    return;
+  }
+
+  HeaderFile *target = getFileInfo(cursor, visitData).target;
+  if (isRecord && !target)
+  {
+    cursor.visitChildren(_kcgHeader_visitClassDecl_onlyBases, visitData);
+    return;
+  }
+  else if (!target)
+  {
+    return;
+  }
+
+  ClangString name = cursor.spelling();
+
+  if (isRecord)
+  {
+    bool isAbstract = clang_CXXRecord_isAbstract(cursor.get()) != 0;
+
+    // Built in place, nothing below adds declarations to the target so the reference stays valid
+    ClassDeclaration &newDecl = target->addClassDeclaration(name.view(), visitData->ns, isAbstract);
+
+    // Without includes the bases are rarely declared, so take them as written and leave resolving them to the inheritance graph
+    _ClassVisitData classVisitData{&newDecl, !visitData->singleFile, visitData};
+    if (visitData->singleFile)
+    {
+      for (auto const &base : getWrittenBaseClasses(visitData->translationUnit, cursor))
+      {
+        newDecl.addBaseClass(base);
+      }
+    }
+
+    cursor.visitChildren(_kcgHeader_visitClassDecl, &classVisitData);
+    cursor.visitChildren(_kcgHeader_visitAnnotations, dynamic_cast<AnnotatedSymbol *>(&newDecl));
+
+    for (auto const &base : newDecl.getBaseClasses())
+    {
+      visitData->header->registerBaseClass(newDecl.getFullyQualifiedName(), std::string(base));
+    }
+  }
+  else
+  {
+    EnumDeclaration &newDecl = target->addEnumDeclaration(name.view(), visitData->ns);
+    cursor.visitChildren(_kcgHeader_visitEnumDecl, &newDecl);
+  }
+}
+
 static CXChildVisitResult _kcgHeader_visitUnit(CXCursor cursor, CXCursor parent, CXClientData client_data)
 {
   _VisitData *visitData = (_VisitData *)client_data;
-  HeaderFile *header = visitData->header;
-  std::string name = clang_getCString(clang_getCursorSpelling(cursor));
   CXCursorKind kind = clang_getCursorKind(cursor);
-  std::string kindStr = clang_getCString(clang_getCursorKindSpelling(kind));
-  CXSourceLocation loc = clang_getCursorLocation(cursor);
-  CXFile file;
-  uint32_t lineno;
-  uint32_t colno;
-  uint32_t wutno;
-  clang_getExpansionLocation(loc, &file, &lineno, &colno, &wutno);
 
-  CXString filepathcl = clang_getFileName(file);
-  std::string filepath = wir::File(clang_getCString(filepathcl)).path();
+  if (kind == CXCursor_Namespace)
+  {
+    ClangString name = ClangCursor(cursor).spelling();
+    if (isPrunedNamespace(cursor, name.view(), visitData))
+    {
+      return CXChildVisit_Continue;
+    }
+
+    NamespaceId outer = visitData->ns;
+    visitData->ns = visitData->symbols->getNamespace(outer, name.view());
+    clang_visitChildren(cursor, _kcgHeader_visitUnit, visitData);
+    visitData->ns = outer;
+  }
+  else
+  {
+    _kcgHeader_visitDeclaration(cursor, visitData);
+  }
 
-  bool sameOrigin = filepath == header->getFilePath() && !isForwardDeclaration(cursor);
+  return CXChildVisit_Continue;
+}
 
-  std::stack<std::string> nss = visitData->ns;
-  std::string ns;
-  while (!nss.empty())
+/**
+ * The namespace a lexical parent stands for, resolved once per namespace cursor. Fails for parents other than
+ * namespaces, and for pruned namespaces, as the visitor would not reach declarations in those.
+ */
+static bool getLexicalNamespace(ClangCursor parent, _VisitData *visitData, NamespaceId &outNamespace)
+{
+  if (parent.isNull() || parent.kind() == CXCursor_TranslationUnit)
   {
-    ns += "::" + nss.top();
-    nss.pop();
+    outNamespace = SymbolTable::GlobalNamespace;
+    return true;
+  }
+
+  auto finder = visitData->lexicalNamespaces.find(parent.get());
+  if (finder != visitData->lexicalNamespaces.end())
+  {
+    outNamespace = finder->second.second;
+    return finder->second.first;
   }
 
-  if ((kind == CXCursor_ClassDecl || kind == CXCursor_StructDecl) && !isForwardDeclaration(cursor))
+  bool reachable = false;
+  NamespaceId ns = SymbolTable::GlobalNamespace;
+  if (parent.kind() == CXCursor_Namespace)
   {
+    ClangString name = parent.spelling();
 
-    if (sameOrigin)
+    NamespaceId outer = SymbolTable::GlobalNamespace;
+    if (!isPrunedNamespace(parent, name.view(), visitData) && getLexicalNamespace(parent.lexicalParent(), visitData, outer))
     {
-      //Log("Class: %s in namespace %s", name.c_str(), ns.c_str());
+      ns = visitData->symbols->getNamespace(outer, name.view());
+      reachable = true;
+    }
+  }
+
+  visitData->lexicalNamespaces.emplace(parent.get(), std::make_pair(reachable, ns));
+  outNamespace = ns;
+  return reachable;
+}
+
+/**
+ * Declarations reported by the indexer, only those the visitor would reach are collected: declared at namespace scope,
+ * outside of classes, functions, linkage specifications and pruned namespaces.
+ */
+static void _kcgHeader_indexDeclaration(CXClientData client_data, CXIdxDeclInfo const *declInfo)
+{
+  _VisitData *visitData = (_VisitData *)client_data;
+  if (declInfo->isImplicit)
+  {
+    return;
+  }
 
-      bool isAbstract = clang_CXXRecord_isAbstract(cursor) != 0;
+  ClangCursor cursor(declInfo->cursor);
+  CXCursorKind kind = cursor.kind();
+  if (kind != CXCursor_ClassDecl && kind != CXCursor_StructDecl && kind != CXCursor_EnumDecl)
+  {
+    return;
+  }
 
-      ClassDeclaration newDecl(name, visitData->ns, isAbstract);
+  if (!getLexicalNamespace(cursor.lexicalParent(), visitData, visitData->ns))
+  {
+    return;
+  }
 
-      clang_visitChildren(cursor, _kcgHeader_visitClassDecl, &newDecl);
-      clang_visitChildren(cursor, _kcgHeader_visitAnnotations, dynamic_cast<AnnotatedSymbol *>(&newDecl));
+  _kcgHeader_visitDeclaration(cursor, visitData);
+}
 
-      for (auto base : newDecl.getBaseClasses())
-      {
-        header->registerBaseClass(newDecl.getFullyQualifiedName(), base);
-      }
+struct _InclusionData
+{
+  std::set<std::string> includes;
 
-      header->addClassDeclaration(newDecl);
-    }
-    else
+  // Including file mapped to the files it included
+  std::map<std::string, std::set<std::string>> directIncludes;
+};
+
+static void _kcgHeader_visitInclusion(CXFile includedFile, CXSourceLocation *inclusionStack, unsigned includeLen, CXClientData client_data)
+{
+  _InclusionData *inclusionData = (_InclusionData *)client_data;
+
+  // The main file is reported with an empty inclusion stack
+  if (includeLen == 0)
+  {
+    return;
+  }
+
+  ClangString filepath = getClangFileName(includedFile);
+  if (!filepath.isNull())
+  {
+    std::string path = wir::File(filepath.str()).path();
+    inclusionData->includes.insert(path);
+
+    // The top of the stack is the #include directive itself
+    CXFile includingFile = nullptr;
+    clang_getExpansionLocation(inclusionStack[0], &includingFile, nullptr, nullptr, nullptr);
+
+    ClangString includingPath = getClangFileName(includingFile);
+    if (!includingPath.isNull())
     {
-      clang_visitChildren(cursor, _kcgHeader_visitClassDecl_onlyBases, visitData);
+      inclusionData->directIncludes[wir::File(includingPath.str()).path()].insert(path);
     }
   }
-  else if (kind == CXCursor_EnumDecl)
+}
+
+/**
+ * The preamble headers a file includes itself. The translation unit skips them, they are already in the preamble, so
+ * they are matched against the #include lines of the file instead.
+ */
+static std::set<std::string> _kcgHeader_findPreambleIncludes(std::string const &path, std::vector<std::string> const &preambleHeaders, std::vector<UnsavedFile> const *unsavedFiles)
+{
+  std::string contents;
+  bool unsaved = false;
+  if (unsavedFiles)
   {
-    if (sameOrigin)
+    for (auto const &unsavedFile : *unsavedFiles)
     {
-
-      //Log("Enum: %s in namespace %s", name.c_str(), ns.c_str());
-      EnumDeclaration newDecl(name, visitData->ns);
-      clang_visitChildren(cursor, _kcgHeader_visitEnumDecl, &newDecl);
-      header->addEnumDeclaration(newDecl);
+      if (unsavedFile.path == path)
+      {
+        contents = unsavedFile.contents;
+        unsaved = true;
+        break;
+      }
     }
   }
-  else if (kind == CXCursor_Namespace)
+
+  if (!unsaved)
+  {
+    std::ifstream file(path, std::ios_base::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  std::set<std::string> included;
+  std::istringstream lines(contents);
+  std::string line;
+  while (std::getline(lines, line))
   {
-    visitData->ns.push(name);
-    clang_visitChildren(cursor, _kcgHeader_visitUnit, visitData);
-    visitData->ns.pop();
+    std::string::size_type start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] != '#')
+    {
+      continue;
+    }
+
+    start = line.find_first_not_of(" \t", start + 1);
+    if (start == std::string::npos || line.compare(start, 7, "include") != 0)
+    {
+      continue;
+    }
+
+    start = line.find_first_of("\"<", start + 7);
+    if (start == std::string::npos)
+    {
+      continue;
+    }
+
+    std::string::size_type end = line.find(line[start] == '"' ? '"' : '>', start + 1);
+    if (end == std::string::npos)
+    {
+      continue;
+    }
+
+    // Matched on the trailing path components, the preamble headers are the paths the includes resolved to before
+    std::string name = "/" + line.substr(start + 1, end - start - 1);
+    for (auto const &preambleHeader : preambleHeaders)
+    {
+      if (preambleHeader.size() >= name.size() && preambleHeader.compare(preambleHeader.size() - name.size(), name.size(), name) == 0)
+      {
+        included.insert(preambleHeader);
+      }
+    }
   }
 
-  return CXChildVisit_Continue;
+  return included;
 }
 
 bool HeaderFile::doesAnyClassInherit(std::string const &parentClass) const
 {
-  for (auto c : m_classDeclarations)
+  for (auto const &c : getClassDeclarations())
   {
     if (doesClassInherit(c.getFullyQualifiedName(), parentClass))
     {
@@ -261,19 +566,222 @@ HeaderFile::HeaderFile()
 {
 }
 
-HeaderFile::HeaderFile(std::string const &inHeaderFilePath, std::vector<std::string> const &cxxFlagsExtra)
+HeaderFile::HeaderFile(std::shared_ptr<SymbolTable> symbols)
+    : m_symbols(std::move(symbols))
+{
+}
+
+HeaderFile::Declarations::Declarations(std::pmr::memory_resource *resource)
+    : classes(resource ? resource : &arena), enums(resource ? resource : &arena)
+{
+}
+
+HeaderFile::Declarations &HeaderFile::getDeclarations()
+{
+  if (!m_declarations)
+  {
+    m_declarations = std::make_unique<Declarations>();
+  }
+
+  return *m_declarations;
+}
+
+SymbolTable &HeaderFile::getSymbols()
+{
+  if (!m_symbols)
+  {
+    m_symbols = std::make_shared<SymbolTable>();
+  }
+
+  return *m_symbols;
+}
+
+void HeaderFile::compactDeclarations()
+{
+  if (!m_declarations)
+  {
+    return;
+  }
+
+  // Moving into another arena goes through the allocator-extended moves, which copy into exactly sized storage
+  auto compacted = std::make_unique<Declarations>();
+  compacted->classes.reserve(m_declarations->classes.size());
+  for (auto &classDecl : m_declarations->classes)
+  {
+    compacted->classes.emplace_back(std::move(classDecl));
+  }
+
+  compacted->enums.reserve(m_declarations->enums.size());
+  for (auto &enumDecl : m_declarations->enums)
+  {
+    compacted->enums.emplace_back(std::move(enumDecl));
+  }
+
+  m_declarations = std::move(compacted);
+}
+
+std::string ParseOptions::getKey() const
+{
+  std::string key = profile == PP_Full ? "profile=full" : "profile=fast";
+  if (engine == PE_Indexer)
+  {
+    key += ";engine=indexer";
+  }
+  if (singleFile)
+  {
+    key += ";singleFile";
+  }
+
+  // The preamble is left out on purpose, it changes how a header is parsed but not what comes out of it
+  return key;
+}
+
+HeaderFile::HeaderFile(std::string const &inHeaderFilePath, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options)
 {
   m_filePath = wir::File(inHeaderFilePath).path();
+  parseTranslationUnit(cxxFlagsExtra, options, {});
+}
+
+HeaderFile HeaderFile::makeFailed(std::string const &headerPath, std::string const &message)
+{
+  HeaderFile header;
+  header.m_filePath = wir::File(headerPath).path();
+  header.m_valid = false;
+
+  HeaderMessage newMessage;
+  newMessage.message = message;
+  newMessage.filename = header.m_filePath;
+  newMessage.severity = MS_Fatal;
+  header.m_messages.push_back(newMessage);
+
+  return header;
+}
+
+void HeaderFile::makePathsRelative(std::string const &rootPath)
+{
+  std::string prefix = rootPath + "/";
+  rewritePaths([&prefix](std::string &path) {
+    if (path.compare(0, prefix.size(), prefix) == 0)
+    {
+      path.erase(0, prefix.size());
+    }
+  });
+}
+
+void HeaderFile::makePathsAbsolute(std::string const &rootPath)
+{
+  std::string prefix = rootPath + "/";
+  rewritePaths([&prefix](std::string &path) {
+    // Placeholders like <Unknown_File> are not paths
+    if (!path.empty() && path[0] != '/' && path[0] != '<')
+    {
+      path.insert(0, prefix);
+    }
+  });
+}
+
+void HeaderFile::rewritePaths(std::function<void(std::string &path)> const &rewrite)
+{
+  rewrite(m_filePath);
+
+  for (auto &include : m_includes)
+  {
+    rewrite(include);
+  }
+  std::sort(m_includes.begin(), m_includes.end());
+
+  for (auto &include : m_directIncludes)
+  {
+    rewrite(include);
+  }
+  std::sort(m_directIncludes.begin(), m_directIncludes.end());
+
+  for (auto &message : m_messages)
+  {
+    rewrite(message.filename);
+  }
+}
+
+std::map<std::string, HeaderFile> HeaderFile::harvest(std::string const &rootHeaderPath, std::vector<std::string> const &harvestedHeaderPaths, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options)
+{
+  std::map<std::string, HeaderFile> headers;
+
+  std::string rootPath = wir::File(rootHeaderPath).path();
+  HeaderFile &rootHeader = headers[rootPath];
+  rootHeader.m_filePath = rootPath;
+
+  std::vector<HeaderFile *> harvestedHeaders;
+  for (auto const &harvestedHeaderPath : harvestedHeaderPaths)
+  {
+    std::string harvestedPath = wir::File(harvestedHeaderPath).path();
+    if (harvestedPath == rootPath)
+    {
+      continue;
+    }
+
+    HeaderFile &harvestedHeader = headers[harvestedPath];
+    harvestedHeader.m_filePath = harvestedPath;
+    harvestedHeaders.push_back(&harvestedHeader);
+  }
+
+  rootHeader.parseTranslationUnit(cxxFlagsExtra, options, harvestedHeaders);
+  return headers;
+}
+
+void HeaderFile::parseTranslationUnit(std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options, std::vector<HeaderFile *> const &harvestedHeaders)
+{
   m_valid = true;
 
-  CXIndex clangIndex = clang_createIndex(0, 0);
+  // Every header filled from this translation unit interns into the same table, names resolved once serve them all
+  if (!m_symbols)
+  {
+    m_symbols = options.symbols ? options.symbols : std::make_shared<SymbolTable>();
+  }
+  for (auto harvestedHeader : harvestedHeaders)
+  {
+    harvestedHeader->m_symbols = m_symbols;
+  }
 
-  std::vector<std::string> cxxFlagsBase = {
-      "-D", "__CODE_GENERATOR__", "-std=c++17"};
+  // Declarations grow one at a time while visiting, so they are built in the scratch pool of this thread and only
+  // compacted into the arenas of the headers once the parse is done. The headers, harvested ones included, outlive
+  // this thread and its pool, so a parse that throws drops whatever is still in the pool on the way out.
+  static thread_local std::pmr::unsynchronized_pool_resource scratch;
 
-  std::vector<std::string> cxxFlagsAll;
-  cxxFlagsAll.insert(cxxFlagsAll.end(), cxxFlagsBase.begin(), cxxFlagsBase.end());
-  cxxFlagsAll.insert(cxxFlagsAll.end(), cxxFlagsExtra.begin(), cxxFlagsExtra.end());
+  struct ScratchDeclarations
+  {
+    ~ScratchDeclarations()
+    {
+      if (!compacted)
+      {
+        for (auto header : headers)
+        {
+          header->m_declarations.reset();
+        }
+      }
+    }
+
+    std::vector<HeaderFile *> headers;
+    bool compacted = false;
+  } scratchDeclarations;
+
+  scratchDeclarations.headers.push_back(this);
+  scratchDeclarations.headers.insert(scratchDeclarations.headers.end(), harvestedHeaders.begin(), harvestedHeaders.end());
+  for (auto header : scratchDeclarations.headers)
+  {
+    header->m_declarations = std::make_unique<Declarations>(&scratch);
+  }
+
+  CXIndex clangIndex = options.units ? options.units->getIndex() : getWorkerIndex();
+
+  std::vector<std::string> cxxFlagsAll = getCompilerFlags(cxxFlagsExtra);
+
+  // A header the preamble itself read would end up declared twice
+  bool usePreamble = options.preamble && !options.singleFile && !options.preamble->contains(m_filePath);
+  if (usePreamble)
+  {
+    cxxFlagsAll.push_back("-include-pch");
+    cxxFlagsAll.push_back(options.preamble->getPchPath());
+  }
 
   /*std::string flagStr;
 	for(auto flag : cxxFlagsAll)
@@ -284,29 +792,95 @@ HeaderFile::HeaderFile(std::string const &inHeaderFilePath, std::vector<std::str
 
 	KLog::print("Full command: clang %s %s\n", m_filePath.c_str(), flagStr.c_str());*/
 
-  uint64_t numFlags = cxxFlagsAll.size();
+  // The flags outlive the parse, libclang copies what it keeps
+  std::vector<char const *> cxxFlags_c;
+  for (auto const &flag : cxxFlagsAll)
+  {
+    cxxFlags_c.push_back(flag.c_str());
+  }
+  int32_t numFlags = (int32_t)cxxFlags_c.size();
 
-  char **cxxFlags_c = new char *[numFlags];
-  for (uint64_t i = 0; i < numFlags; i++)
+  // Points into the options, which outlive the parse
+  std::vector<CXUnsavedFile> unsavedFiles;
+  if (options.unsavedFiles)
   {
-    uint64_t currSize = cxxFlagsAll[i].size() + 1;
-    cxxFlags_c[i] = new char[currSize];
-    snprintf(cxxFlags_c[i], currSize, "%s", cxxFlagsAll[i].c_str());
+    for (auto const &unsavedFile : *options.unsavedFiles)
+    {
+      unsavedFiles.push_back({unsavedFile.path.c_str(), unsavedFile.contents.data(), (unsigned long)unsavedFile.contents.size()});
+    }
   }
+  uint32_t numUnsavedFiles = (uint32_t)unsavedFiles.size();
 
-  CXTranslationUnit translationUnit = nullptr;
-  //CXErrorCode error = clang_parseTranslationUnit2(clangIndex, m_filePath.c_str(), cxxFlags_c, numFlags, nullptr, 0, CXTranslationUnit_None, &translationUnit);
-  CXErrorCode error = clang_parseTranslationUnit2(clangIndex, m_filePath.c_str(), cxxFlags_c, numFlags, nullptr, 0, CXTranslationUnit_None, &translationUnit);
-  //CXErrorCode error = clang_parseTranslationUnit2FullArgv(
-  //    clangIndex, m_filePath.c_str(), cxxFlags_c, numFlags, nullptr, 0, CXTranslationUnit_None, &translationUnit
-  //);
+  // Only declarations, base specifiers, method names and annotations are ever looked at, so the fast profile
+  // leaves out function bodies and everything below error level in included files
+  uint32_t parseFlags = CXTranslationUnit_None;
+  if (options.profile == PP_Fast)
+  {
+    parseFlags = CXTranslationUnit_SkipFunctionBodies | CXTranslationUnit_KeepGoing | CXTranslationUnit_IgnoreNonErrorsFromIncludedFiles;
+  }
+
+  if (options.singleFile)
+  {
+    parseFlags |= CXTranslationUnit_SingleFileParse | CXTranslationUnit_KeepGoing;
+  }
+
+  // Units that are kept get a preamble of their includes on the first reparse, later reparses only redo the header
+  if (options.units)
+  {
+    parseFlags |= CXTranslationUnit_PrecompiledPreamble;
+  }
 
-  for (uint64_t i = 0; i < numFlags; i++)
+  _VisitData visitData{this};
+  visitData.symbols = m_symbols.get();
+  visitData.singleFile = options.singleFile;
+  visitData.targets[m_filePath] = this;
+  for (auto harvestedHeader : harvestedHeaders)
   {
-    delete[] cxxFlags_c[i];
+    visitData.targets[harvestedHeader->m_filePath] = harvestedHeader;
   }
 
-  delete[] cxxFlags_c;
+  ClangTranslationUnit translationUnit;
+  CXErrorCode error = CXError_Success;
+  bool reparsed = false;
+  if (options.units && options.units->take(m_filePath, cxxFlagsAll, translationUnit))
+  {
+    // A failed reparse leaves the unit unusable, it is thrown away and parsed from scratch
+    reparsed = clang_reparseTranslationUnit(translationUnit.get(), numUnsavedFiles, unsavedFiles.data(), clang_defaultReparseOptions(translationUnit.get())) == 0;
+    if (!reparsed)
+    {
+      translationUnit.reset();
+    }
+  }
+
+  // Index actions belong to the worker and go away with it, so kept units are always parsed from the index of the
+  // pool and read with the visitor
+  if (!reparsed && options.engine == PE_Indexer && !options.units)
+  {
+    // Declarations arrive through the callback while parsing. The session of the worker remembers which bodies it
+    // already went through, so headers shared between translation units only have theirs parsed once per worker.
+    IndexerCallbacks callbacks = {};
+    callbacks.indexDeclaration = _kcgHeader_indexDeclaration;
+
+    // Single file parses read base classes from tokens, which needs the translation unit during the callbacks.
+    // It is only handed out once indexing has finished, so those are collected by the visitor afterwards.
+    if (options.singleFile)
+    {
+      callbacks.indexDeclaration = nullptr;
+    }
+
+    int32_t indexError = clang_indexSourceFile(getWorkerIndexAction(), &visitData, &callbacks, sizeof(callbacks), CXIndexOpt_SkipParsedBodiesInSession, m_filePath.c_str(), cxxFlags_c.data(), numFlags, unsavedFiles.data(), numUnsavedFiles, translationUnit.reset(), parseFlags);
+    if (indexError != 0 || translationUnit.isNull())
+    {
+      error = CXError_Failure;
+    }
+  }
+  else if (!reparsed)
+  {
+    error = clang_parseTranslationUnit2(clangIndex, m_filePath.c_str(), cxxFlags_c.data(), numFlags, unsavedFiles.data(), numUnsavedFiles, parseFlags, translationUnit.reset());
+  }
+  //CXErrorCode error = clang_parseTranslationUnit2FullArgv(
+  //    clangIndex, m_filePath.c_str(), cxxFlags_c, numFlags, nullptr, 0, CXTranslationUnit_None, &translationUnit
+  //);
 
   if (error != CXError_Success)
   {
@@ -316,39 +890,52 @@ HeaderFile::HeaderFile(std::string const &inHeaderFilePath, std::vector<std::str
     newMessage.filename = m_filePath;
     newMessage.severity = MS_Fatal;
     m_messages.push_back(newMessage);
+
+    for (auto harvestedHeader : harvestedHeaders)
+    {
+      harvestedHeader->m_valid = false;
+      harvestedHeader->m_messages = m_messages;
+    }
   }
 
   if (m_valid)
   {
     // Fill the diagnostics messages
-    uint32_t numDiagnostics = clang_getNumDiagnostics(translationUnit);
+    uint32_t numDiagnostics = translationUnit.getNumDiagnostics();
     for (uint32_t i = 0; i < numDiagnostics; i++)
     {
       HeaderMessage newMessage;
 
-      CXDiagnostic currDiag = clang_getDiagnostic(translationUnit, i);
-      CXDiagnosticSeverity severity = clang_getDiagnosticSeverity(currDiag);
+      ClangDiagnostic currDiag = translationUnit.getDiagnostic(i);
+      CXDiagnosticSeverity severity = currDiag.severity();
 
-      // Get the expansion location
-      CXSourceLocation loc = clang_getDiagnosticLocation(currDiag);
-      CXFile file;
-      uint32_t _line;
-      uint32_t _col;
-      uint32_t wutno;
+      if (options.profile == PP_Fast && severity != CXDiagnostic_Error && severity != CXDiagnostic_Fatal)
+      {
+        continue;
+      }
 
-      clang_getExpansionLocation(loc, &file, &_line, &_col, &wutno);
-      CXString clangFile = clang_getFileName(file);
-      char const *cFile = clang_getCString(clangFile);
+      // Without includes most types are undeclared, errors are expected and only fatal diagnostics are kept
+      if (options.singleFile && severity != CXDiagnostic_Fatal)
+      {
+        continue;
+      }
 
-      if (cFile != nullptr)
+      // Get the expansion location
+      CXFile file = nullptr;
+      uint32_t _line = 0;
+      uint32_t _col = 0;
+      currDiag.location(file, _line, _col);
+
+      ClangString clangFile = getClangFileName(file);
+      if (!clangFile.isNull())
       {
-        newMessage.filename = wir::File(cFile).path();
+        newMessage.filename = wir::File(clangFile.str()).path();
       }
       else
       {
         newMessage.filename = "<Unknown_File>";
       }
-      newMessage.message = clang_getCString(clang_getDiagnosticSpelling(currDiag));
+      newMessage.message = currDiag.spelling().str();
       newMessage.line = _line;
       newMessage.col = _col;
 
@@ -376,51 +963,245 @@ HeaderFile::HeaderFile(std::string const &inHeaderFilePath, std::vector<std::str
       m_messages.push_back(newMessage);
     }
 
-    CXCursor cursor = clang_getTranslationUnitCursor(translationUnit);
-    _VisitData visitData{this};
+    if (options.engine == PE_Visitor || options.singleFile || options.units)
+    {
+      visitData.translationUnit = translationUnit.get();
+      visitData.ns = SymbolTable::GlobalNamespace;
+      translationUnit.cursor().visitChildren(_kcgHeader_visitUnit, &visitData);
+    }
+
+    // Record everything the translation unit read, so staleness can be decided from the full input set
+    _InclusionData inclusionData;
+    clang_getInclusions(translationUnit.get(), _kcgHeader_visitInclusion, &inclusionData);
+
+    // What the preamble read is a single dependency, the preamble itself, and stays out of the includes. Only the
+    // preamble headers a header includes itself count as its direct includes, so the preamble is picked by what the
+    // inputs use on the next run.
+    if (usePreamble)
+    {
+      for (auto it = inclusionData.includes.begin(); it != inclusionData.includes.end();)
+      {
+        it = options.preamble->contains(*it) ? inclusionData.includes.erase(it) : std::next(it);
+      }
+
+      m_preambleHash = options.preamble->getContentHash();
+      auto ownPreambleIncludes = _kcgHeader_findPreambleIncludes(m_filePath, options.preamble->getHeaders(), options.unsavedFiles.get());
+      inclusionData.directIncludes[m_filePath].insert(ownPreambleIncludes.begin(), ownPreambleIncludes.end());
+      for (auto harvestedHeader : harvestedHeaders)
+      {
+        harvestedHeader->m_preambleHash = m_preambleHash;
+        auto harvestedPreambleIncludes = _kcgHeader_findPreambleIncludes(harvestedHeader->m_filePath, options.preamble->getHeaders(), options.unsavedFiles.get());
+        inclusionData.directIncludes[harvestedHeader->m_filePath].insert(harvestedPreambleIncludes.begin(), harvestedPreambleIncludes.end());
+      }
+    }
+
+    auto const &ownDirectIncludes = inclusionData.directIncludes[m_filePath];
+    m_directIncludes.assign(ownDirectIncludes.begin(), ownDirectIncludes.end());
+
+    // Harvested headers share the inheritance data and diagnostics of the translation unit. They depend on
+    // everything it read, which is a superset of what they would have read on their own.
+    for (auto harvestedHeader : harvestedHeaders)
+    {
+      if (inclusionData.includes.find(harvestedHeader->m_filePath) == inclusionData.includes.end())
+      {
+        harvestedHeader->m_valid = false;
+        HeaderMessage newMessage;
+        newMessage.message = wir::format("Not included by %s, can not be harvested from it", m_filePath.c_str());
+        newMessage.filename = harvestedHeader->m_filePath;
+        newMessage.severity = MS_Fatal;
+        harvestedHeader->m_messages.push_back(newMessage);
+        continue;
+      }
+
+      harvestedHeader->m_valid = m_valid;
+      harvestedHeader->m_messages = m_messages;
+      harvestedHeader->m_inheritMap = m_inheritMap;
+      harvestedHeader->m_inheritanceCompiled = false;
+
+      std::set<std::string> harvestedIncludes = inclusionData.includes;
+      harvestedIncludes.insert(m_filePath);
+      harvestedIncludes.erase(harvestedHeader->m_filePath);
+      harvestedHeader->m_includes.assign(harvestedIncludes.begin(), harvestedIncludes.end());
+
+      auto const &harvestedDirectIncludes = inclusionData.directIncludes[harvestedHeader->m_filePath];
+      harvestedHeader->m_directIncludes.assign(harvestedDirectIncludes.begin(), harvestedDirectIncludes.end());
+    }
+
+    inclusionData.includes.erase(m_filePath);
+    m_includes.assign(inclusionData.includes.begin(), inclusionData.includes.end());
+  }
+
+  if (options.units && error == CXError_Success)
+  {
+    options.units->put(m_filePath, cxxFlagsAll, std::move(translationUnit));
+  }
+
+  for (auto header : scratchDeclarations.headers)
+  {
+    header->compactDeclarations();
+  }
+  scratchDeclarations.compacted = true;
+
+  // Anything not kept is disposed on the way out, which closes file handles and frees up memory
+}
+
+std::vector<std::string> HeaderFile::getCompilerFlags(std::vector<std::string> const &cxxFlagsExtra)
+{
+  std::vector<std::string> cxxFlagsAll = {
+      "-D", "__CODE_GENERATOR__", "-std=c++17"};
+
+  cxxFlagsAll.insert(cxxFlagsAll.end(), cxxFlagsExtra.begin(), cxxFlagsExtra.end());
+  return cxxFlagsAll;
+}
 
-    clang_visitChildren(cursor, _kcgHeader_visitUnit, &visitData);
+std::string HeaderFile::getParserVersion()
+{
+  // Asking libclang for its version would load it, the library file identifies it just as well and is only a stat.
+  // Used even once it is loaded, so the result stays the same for the whole run.
+  std::string identity;
+  if (getClangLibraryIdentity(identity))
+  {
+    return identity;
   }
 
-  // Dispose of the translation unit, this closes file handles and frees up memory
-  clang_disposeTranslationUnit(translationUnit);
+  return ClangString(clang_getClangVersion()).str();
 }
 
-void HeaderFile::addClassDeclaration(const ClassDeclaration &newDecl)
+ClassDeclaration &HeaderFile::addClassDeclaration(std::string_view name, NamespaceId ns, bool abstract)
 {
-  m_classDeclarations.push_back(newDecl);
+  return getDeclarations().classes.emplace_back(getSymbols(), name, ns, abstract);
 }
 
-void HeaderFile::addEnumDeclaration(const EnumDeclaration &newDecl)
+EnumDeclaration &HeaderFile::addEnumDeclaration(std::string_view name, NamespaceId ns)
 {
-  m_enumDeclarations.push_back(newDecl);
+  return getDeclarations().enums.emplace_back(getSymbols(), name, ns);
+}
+
+void HeaderFile::setInheritMap(std::map<std::string, std::set<std::string>> const &inheritMap)
+{
+  m_inheritMap = inheritMap;
+  m_inheritanceCompiled = false;
 }
 
 void HeaderFile::registerBaseClass(std::string const &childClassName, std::string const &parentClassName)
 {
   std::set<std::string> &bases = m_inheritMap[childClassName];
   bases.insert(parentClassName);
+  m_inheritanceCompiled = false;
 }
 
-std::set<std::string> HeaderFile::getInheritedClassesFor(std::string const &className, bool topLevelOnly) const
+void HeaderFile::compileInheritance() const
 {
-  auto finder = m_inheritMap.find(className);
-  if (finder == m_inheritMap.end())
+  if (m_inheritanceCompiled)
   {
-    return {};
+    return;
   }
 
-  std::set<std::string> returner;
+  // Ids follow the lexicographic order of the names, so sorted id arrays map back to sorted name sets directly
+  std::set<std::string> names;
+  for (auto const &edge : m_inheritMap)
+  {
+    names.insert(edge.first);
+    names.insert(edge.second.begin(), edge.second.end());
+  }
+
+  m_classNames.assign(names.begin(), names.end());
 
-  for (auto base : finder->second)
+  std::vector<std::vector<uint32_t>> directBases(m_classNames.size());
+  for (auto const &edge : m_inheritMap)
   {
-    returner.insert(base);
+    std::vector<uint32_t> &bases = directBases[findClassId(edge.first)];
+    for (auto const &base : edge.second)
+    {
+      bases.push_back(findClassId(base));
+    }
+  }
 
-    if (!topLevelOnly)
+  // Each closure is the union of the direct bases and their closures, every class is expanded once. A class met
+  // again while it is still being expanded closes a cycle, which only contributes the part known at that point.
+  enum ClosureState : uint8_t
+  {
+    CS_Pending,
+    CS_Expanding,
+    CS_Done
+  };
+
+  m_inheritClosure.assign(m_classNames.size(), {});
+  std::vector<ClosureState> states(m_classNames.size(), CS_Pending);
+  std::vector<std::pair<uint32_t, size_t>> stack;
+  for (uint32_t root = 0; root < m_classNames.size(); root++)
+  {
+    if (states[root] != CS_Pending)
     {
-      std::set<std::string> deepBases = getInheritedClassesFor(base, false);
-      returner.merge(deepBases);
+      continue;
     }
+
+    states[root] = CS_Expanding;
+    stack.emplace_back(root, 0);
+    while (!stack.empty())
+    {
+      uint32_t classId = stack.back().first;
+      size_t &nextBase = stack.back().second;
+      if (nextBase < directBases[classId].size())
+      {
+        uint32_t baseId = directBases[classId][nextBase++];
+        if (states[baseId] == CS_Pending)
+        {
+          states[baseId] = CS_Expanding;
+          stack.emplace_back(baseId, 0);
+        }
+        continue;
+      }
+
+      std::vector<uint32_t> &closure = m_inheritClosure[classId];
+      for (uint32_t baseId : directBases[classId])
+      {
+        closure.push_back(baseId);
+        closure.insert(closure.end(), m_inheritClosure[baseId].begin(), m_inheritClosure[baseId].end());
+      }
+
+      std::sort(closure.begin(), closure.end());
+      closure.erase(std::unique(closure.begin(), closure.end()), closure.end());
+
+      states[classId] = CS_Done;
+      stack.pop_back();
+    }
+  }
+
+  m_inheritanceCompiled = true;
+}
+
+uint32_t HeaderFile::findClassId(std::string const &className) const
+{
+  auto finder = std::lower_bound(m_classNames.begin(), m_classNames.end(), className);
+  if (finder == m_classNames.end() || *finder != className)
+  {
+    return InvalidClassId;
+  }
+
+  return uint32_t(finder - m_classNames.begin());
+}
+
+std::set<std::string> HeaderFile::getInheritedClassesFor(std::string const &className, bool topLevelOnly) const
+{
+  if (topLevelOnly)
+  {
+    auto finder = m_inheritMap.find(className);
+    return finder != m_inheritMap.end() ? finder->second : std::set<std::string>();
+  }
+
+  compileInheritance();
+
+  std::set<std::string> returner;
+  uint32_t classId = findClassId(className);
+  if (classId == InvalidClassId)
+  {
+    return returner;
+  }
+
+  for (uint32_t baseId : m_inheritClosure[classId])
+  {
+    returner.insert(returner.end(), m_classNames[baseId]);
   }
 
   return returner;
@@ -428,8 +1209,17 @@ std::set<std::string> HeaderFile::getInheritedClassesFor(std::string const &clas
 
 bool HeaderFile::doesClassInherit(std::string const &className, std::string const &parentClass) const
 {
-  auto v = getInheritedClassesFor(className, false);
-  return (v.find(parentClass) != v.end());
+  compileInheritance();
+
+  uint32_t classId = findClassId(className);
+  uint32_t parentId = findClassId(parentClass);
+  if (classId == InvalidClassId || parentId == InvalidClassId)
+  {
+    return false;
+  }
+
+  auto const &closure = m_inheritClosure[classId];
+  return std::binary_search(closure.begin(), closure.end(), parentId);
 }
 
 bool HeaderFile::serialize(wir::Stream &toStream) const
@@ -437,28 +1227,54 @@ bool HeaderFile::serialize(wir::Stream &toStream) const
   toStream << m_valid;
   toStream << m_filePath;
   toStream << (uint64_t)m_inheritMap.size();
-  for (auto e : m_inheritMap)
+  for (auto const &e : m_inheritMap)
   {
     toStream << e.first;
     toStream << (uint64_t)e.second.size();
-    for (auto s : e.second)
+    for (auto const &s : e.second)
     {
       toStream << s;
     }
   }
 
-  toStream << (uint64_t)m_classDeclarations.size();
-  for (auto c : m_classDeclarations)
+  auto classDeclarations = getClassDeclarations();
+  toStream << (uint64_t)classDeclarations.size();
+  for (auto const &c : classDeclarations)
   {
     toStream << c;
   }
 
-  toStream << (uint64_t)m_enumDeclarations.size();
-  for (auto e : m_enumDeclarations)
+  auto enumDeclarations = getEnumDeclarations();
+  toStream << (uint64_t)enumDeclarations.size();
+  for (auto const &e : enumDeclarations)
   {
     toStream << e;
   }
 
+  toStream << (uint64_t)m_includes.size();
+  for (auto const &include : m_includes)
+  {
+    toStream << include;
+  }
+
+  toStream << (uint64_t)m_directIncludes.size();
+  for (auto const &include : m_directIncludes)
+  {
+    toStream << include;
+  }
+  toStream << m_preambleHash;
+
+  // Kept so a header that failed to parse elsewhere still explains why
+  toStream << (uint64_t)m_messages.size();
+  for (auto const &message : m_messages)
+  {
+    toStream << message.message;
+    toStream << message.filename;
+    toStream << message.line;
+    toStream << message.col;
+    toStream << (uint8_t)message.severity;
+  }
+
   return true;
 }
 
@@ -468,15 +1284,14 @@ bool HeaderFile::deserialize(wir::Stream &fromStream)
   fromStream >> m_filePath;
 
   m_inheritMap.clear();
-  uint64_t numInherit = 0;
-  fromStream >> numInherit;
+  m_inheritanceCompiled = false;
+  uint64_t numInherit = readCount(fromStream);
   for (uint64_t i = 0; i < numInherit; i++)
   {
     std::string inheritClass = "";
     fromStream >> inheritClass;
 
-    uint64_t numBases = 0;
-    fromStream >> numBases;
+    uint64_t numBases = readCount(fromStream);
 
     for (uint64_t j = 0; j < numBases; j++)
     {
@@ -486,30 +1301,60 @@ bool HeaderFile::deserialize(wir::Stream &fromStream)
     }
   }
 
-  m_classDeclarations.clear();
-  uint64_t numClasses;
-  fromStream >> numClasses;
+  // A fresh arena, whatever the previous declarations allocated goes away with the old one
+  m_declarations = std::make_unique<Declarations>();
+
+  uint64_t numClasses = readCount(fromStream);
+  m_declarations->classes.reserve(numClasses);
   for (uint64_t i = 0; i < numClasses; i++)
   {
-    ClassDeclaration newDecl;
-    fromStream >> newDecl;
-    m_classDeclarations.push_back(newDecl);
+    fromStream >> m_declarations->classes.emplace_back(getSymbols());
   }
 
-  m_enumDeclarations.clear();
-  uint64_t numEnums;
-  fromStream >> numEnums;
+  uint64_t numEnums = readCount(fromStream);
+  m_declarations->enums.reserve(numEnums);
   for (uint64_t i = 0; i < numEnums; i++)
   {
-    EnumDeclaration newDecl;
-    fromStream >> newDecl;
-    m_enumDeclarations.push_back(newDecl);
+    fromStream >> m_declarations->enums.emplace_back(getSymbols());
+  }
+
+  m_includes.clear();
+  uint64_t numIncludes = readCount(fromStream);
+  for (uint64_t i = 0; i < numIncludes; i++)
+  {
+    std::string newInclude;
+    fromStream >> newInclude;
+    m_includes.push_back(newInclude);
+  }
+
+  m_directIncludes.clear();
+  uint64_t numDirectIncludes = readCount(fromStream);
+  for (uint64_t i = 0; i < numDirectIncludes; i++)
+  {
+    std::string newInclude;
+    fromStream >> newInclude;
+    m_directIncludes.push_back(newInclude);
+  }
+  fromStream >> m_preambleHash;
+
+  m_messages.clear();
+  uint64_t numMessages = readCount(fromStream);
+  for (uint64_t i = 0; i < numMessages; i++)
+  {
+    HeaderMessage &newMessage = m_messages.emplace_back();
+    uint8_t severity = MS_Ignored;
+    fromStream >> newMessage.message;
+    fromStream >> newMessage.filename;
+    fromStream >> newMessage.line;
+    fromStream >> newMessage.col;
+    fromStream >> severity;
+    newMessage.severity = (HeaderMessageSeverity)severity;
   }
 
   return true;
 }
 
-std::string HeaderMessage::prettyPrint()
+std::string HeaderMessage::prettyPrint() const
 {
 
   std::stringstream ss;
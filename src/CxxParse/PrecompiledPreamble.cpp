@@ -0,0 +1,320 @@
+#include "CxxParse/PrecompiledPreamble.hpp"
+
+#include "ContentHash.hpp"
+#include "CxxParse/Clang.hpp"
+#include "CxxParse/HeaderFile.hpp"
+#include "CxxParse/WorkerIndex.hpp"
+#include "SerializableFile.hpp"
+
+#include <WIR/Error.hpp>
+#include <WIR/Filesystem.hpp>
+
+#include <clang-c/Index.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <system_error>
+
+namespace
+{
+  // Bump whenever the serialized layout changes
+  uint32_t const preambleFormatVersion = 1;
+
+  void collectInclusion(CXFile includedFile, CXSourceLocation *inclusionStack, unsigned includeLen, CXClientData client_data)
+  {
+    std::set<std::string> *includes = (std::set<std::string> *)client_data;
+    if (includeLen == 0)
+    {
+      return;
+    }
+
+    ClangString filepath = getClangFileName(includedFile);
+    if (!filepath.isNull())
+    {
+      includes->insert(wir::File(filepath.str()).path());
+    }
+  }
+}
+
+std::vector<std::string> PrecompiledPreamble::selectHeaders(std::vector<std::vector<std::string>> const &directIncludes, std::string const &excludedDirectory, double threshold)
+{
+  std::map<std::string, uint64_t> counts;
+  for (auto const &includes : directIncludes)
+  {
+    for (auto const &include : includes)
+    {
+      // Project headers change too often to be worth precompiling, and could not be parsed on top of the preamble themselves
+      if (include.compare(0, excludedDirectory.size(), excludedDirectory) == 0)
+      {
+        continue;
+      }
+
+      counts[include]++;
+    }
+  }
+
+  uint64_t minimumCount = std::max<uint64_t>(2, uint64_t(threshold * double(directIncludes.size())));
+
+  std::vector<std::pair<uint64_t, std::string>> selected;
+  for (auto const &count : counts)
+  {
+    if (count.second >= minimumCount)
+    {
+      selected.push_back({count.second, count.first});
+    }
+  }
+
+  std::sort(selected.begin(), selected.end(), [](auto const &a, auto const &b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+
+  std::vector<std::string> headers;
+  for (auto const &entry : selected)
+  {
+    headers.push_back(entry.second);
+  }
+
+  return headers;
+}
+
+bool PrecompiledPreamble::prepare(std::string const &cacheDirectory, std::vector<std::string> const &headers, std::vector<std::string> const &cxxFlagsExtra, FileHashCache &hashes)
+{
+  if (headers.empty())
+  {
+    return false;
+  }
+
+  std::string directory = wir::Directory(cacheDirectory).path();
+  std::string metaPath = directory + "/preamble.meta";
+  std::string preludePath = directory + "/preamble.hpp";
+  std::string pchPath = directory + "/preamble.pch";
+
+  uint64_t flagsHash = hashStrings(HeaderFile::getCompilerFlags(cxxFlagsExtra), hashString(HeaderFile::getParserVersion()));
+
+  PrecompiledPreamble previous;
+  if (readSerializable(metaPath, previous) && previous.isCurrent(pchPath, headers, flagsHash, hashes))
+  {
+    *this = previous;
+    return true;
+  }
+
+  Log("Building precompiled preamble from %llu headers", (unsigned long long)headers.size());
+
+  // Replaced through a temporary file, a concurrent run sharing the cache must never compile a half-written prelude.
+  // An unchanged prelude keeps its modification time, which the precompiled header was validated against.
+  std::string prelude = "/* File is automatically generated by WIR, any changes manually made will be lost. */\n";
+  for (auto const &header : headers)
+  {
+    prelude += "#include \"" + header + "\"\n";
+  }
+
+  bool preludeChanged = false;
+  if (!writeFileIfChanged(preludePath, prelude, preludeChanged))
+  {
+    LogError("Failed to write the preamble prelude (%s)", preludePath.c_str());
+    return false;
+  }
+
+  m_headers = headers;
+  m_flagsHash = flagsHash;
+  m_pchPath = pchPath;
+  if (!build(preludePath, pchPath, cxxFlagsExtra))
+  {
+    return false;
+  }
+
+  m_includeHashes.clear();
+  for (auto const &include : m_includes)
+  {
+    uint64_t includeHash = 0;
+    if (!hashes.getHash(include, includeHash))
+    {
+      return false;
+    }
+
+    m_includeHashes.push_back(includeHash);
+  }
+  computeContentHash();
+
+  if (!writeSerializable(metaPath, *this))
+  {
+    LogWarning("Failed to save the preamble metadata (%s)", metaPath.c_str());
+  }
+
+  return true;
+}
+
+bool PrecompiledPreamble::loadCurrent(std::string const &cacheDirectory, FileHashCache &hashes)
+{
+  std::string metaPath = wir::Directory(cacheDirectory).path() + "/preamble.meta";
+  return readSerializable(metaPath, *this) && wir::File(m_pchPath).exist() && areIncludesCurrent(hashes);
+}
+
+bool PrecompiledPreamble::contains(std::string const &headerPath) const
+{
+  return m_includeSet.find(headerPath) != m_includeSet.end();
+}
+
+bool PrecompiledPreamble::isCurrent(std::string const &pchPath, std::vector<std::string> const &headers, uint64_t flagsHash, FileHashCache &hashes) const
+{
+  if (m_pchPath != pchPath || m_headers != headers || m_flagsHash != flagsHash || !wir::File(pchPath).exist())
+  {
+    return false;
+  }
+
+  return areIncludesCurrent(hashes);
+}
+
+bool PrecompiledPreamble::areIncludesCurrent(FileHashCache &hashes) const
+{
+  for (uint64_t i = 0; i < m_includes.size(); i++)
+  {
+    uint64_t currentHash = 0;
+    if (!hashes.getHash(m_includes[i], currentHash) || currentHash != m_includeHashes[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void PrecompiledPreamble::computeContentHash()
+{
+  m_contentHash = hashStrings(m_headers, m_flagsHash);
+  m_contentHash = hashStrings(m_includes, m_contentHash);
+  m_contentHash = hashBytes(m_includeHashes.data(), m_includeHashes.size() * sizeof(uint64_t), m_contentHash);
+}
+
+bool PrecompiledPreamble::build(std::string const &preludePath, std::string const &pchPath, std::vector<std::string> const &cxxFlagsExtra)
+{
+  std::vector<std::string> cxxFlagsAll = HeaderFile::getCompilerFlags(cxxFlagsExtra);
+  cxxFlagsAll.push_back("-x");
+  cxxFlagsAll.push_back("c++-header");
+
+  std::vector<char const *> cxxFlags_c;
+  for (auto const &flag : cxxFlagsAll)
+  {
+    cxxFlags_c.push_back(flag.c_str());
+  }
+
+  ClangTranslationUnit translationUnit;
+  uint32_t parseFlags = CXTranslationUnit_ForSerialization | CXTranslationUnit_Incomplete;
+  CXErrorCode error = clang_parseTranslationUnit2(getWorkerIndex(), preludePath.c_str(), cxxFlags_c.data(), (int)cxxFlags_c.size(), nullptr, 0, parseFlags, translationUnit.reset());
+  if (error != CXError_Success)
+  {
+    LogError("Failed to parse the preamble prelude (%s)", preludePath.c_str());
+    return false;
+  }
+
+  bool valid = true;
+  uint32_t numDiagnostics = translationUnit.getNumDiagnostics();
+  for (uint32_t i = 0; i < numDiagnostics; i++)
+  {
+    ClangDiagnostic diagnostic = translationUnit.getDiagnostic(i);
+    CXDiagnosticSeverity severity = diagnostic.severity();
+    if (severity == CXDiagnostic_Error || severity == CXDiagnostic_Fatal)
+    {
+      ClangString message = diagnostic.format();
+      LogError("Preamble: %s", message.str().c_str());
+      valid = false;
+    }
+  }
+
+  std::set<std::string> includes;
+  clang_getInclusions(translationUnit.get(), collectInclusion, &includes);
+  m_includes.assign(includes.begin(), includes.end());
+  m_includeSet = includes;
+
+  // Save next to the final path and rename, a concurrent run must never pick up a half-written PCH
+  std::string tempPath = makeTempPath(pchPath);
+  if (valid && !translationUnit.save(tempPath))
+  {
+    LogError("Failed to save the precompiled preamble (%s)", pchPath.c_str());
+    valid = false;
+  }
+
+  // Release the AST before renaming, nothing below needs it
+  translationUnit.reset();
+
+  if (valid)
+  {
+    std::error_code renameError;
+    std::filesystem::rename(tempPath, pchPath, renameError);
+    valid = !renameError;
+  }
+
+  if (!valid)
+  {
+    std::error_code removeError;
+    std::filesystem::remove(tempPath, removeError);
+  }
+
+  return valid;
+}
+
+bool PrecompiledPreamble::serialize(wir::Stream &toStream) const
+{
+  toStream << preambleFormatVersion;
+  toStream << m_pchPath;
+  toStream << m_flagsHash;
+
+  toStream << (uint64_t)m_headers.size();
+  for (auto const &header : m_headers)
+  {
+    toStream << header;
+  }
+
+  toStream << (uint64_t)m_includes.size();
+  for (uint64_t i = 0; i < m_includes.size(); i++)
+  {
+    toStream << m_includes[i];
+    toStream << m_includeHashes[i];
+  }
+
+  return true;
+}
+
+bool PrecompiledPreamble::deserialize(wir::Stream &fromStream)
+{
+  m_headers.clear();
+  m_includes.clear();
+  m_includeHashes.clear();
+  m_includeSet.clear();
+
+  uint32_t version = 0;
+  fromStream >> version;
+  if (version != preambleFormatVersion)
+  {
+    return false;
+  }
+
+  fromStream >> m_pchPath;
+  fromStream >> m_flagsHash;
+
+  uint64_t numHeaders = 0;
+  fromStream >> numHeaders;
+  for (uint64_t i = 0; i < numHeaders; i++)
+  {
+    std::string header;
+    fromStream >> header;
+    m_headers.push_back(header);
+  }
+
+  uint64_t numIncludes = 0;
+  fromStream >> numIncludes;
+  for (uint64_t i = 0; i < numIncludes; i++)
+  {
+    std::string include;
+    uint64_t includeHash = 0;
+    fromStream >> include;
+    fromStream >> includeHash;
+    m_includes.push_back(include);
+    m_includeHashes.push_back(includeHash);
+    m_includeSet.insert(include);
+  }
+
+  computeContentHash();
+  return true;
+}
@@ -0,0 +1,111 @@
+#include "CxxParse/SymbolTable.hpp"
+
+#include <mutex>
+
+SymbolTable::SymbolTable()
+{
+  NamespaceNode &global = m_namespaces.emplace_back();
+  global.name = &internLocked("");
+  global.qualifiedName = global.name;
+}
+
+NamespaceId SymbolTable::getNamespace(NamespaceId parent, std::string_view name)
+{
+  {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto const &children = m_namespaces[parent].children;
+    auto finder = children.find(name);
+    if (finder != children.end())
+    {
+      return finder->second;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+  // Another thread may have created it in between
+  auto finder = m_namespaces[parent].children.find(name);
+  if (finder != m_namespaces[parent].children.end())
+  {
+    return finder->second;
+  }
+
+  NamespaceId id = NamespaceId(m_namespaces.size());
+  std::string const &parentName = *m_namespaces[parent].qualifiedName;
+
+  NamespaceNode &node = m_namespaces.emplace_back();
+  node.parent = parent;
+  node.name = &internLocked(name);
+  node.qualifiedName = parentName.empty() ? node.name : &internLocked(parentName + "::" + std::string(name));
+
+  m_namespaces[parent].children[*node.name] = id;
+  return id;
+}
+
+NamespaceId SymbolTable::getNamespace(std::vector<std::string> const &path)
+{
+  NamespaceId ns = GlobalNamespace;
+  for (auto const &name : path)
+  {
+    ns = getNamespace(ns, name);
+  }
+
+  return ns;
+}
+
+std::vector<std::string> SymbolTable::getPath(NamespaceId ns) const
+{
+  std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+  std::vector<std::string> path;
+  while (ns != GlobalNamespace)
+  {
+    path.push_back(*m_namespaces[ns].name);
+    ns = m_namespaces[ns].parent;
+  }
+
+  return std::vector<std::string>(path.rbegin(), path.rend());
+}
+
+std::string const &SymbolTable::getQualifiedName(NamespaceId ns) const
+{
+  std::shared_lock<std::shared_mutex> lock(m_mutex);
+  return *m_namespaces[ns].qualifiedName;
+}
+
+std::string const &SymbolTable::intern(std::string_view name)
+{
+  {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto finder = m_strings.find(name);
+    if (finder != m_strings.end())
+    {
+      return *finder;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(m_mutex);
+  return internLocked(name);
+}
+
+std::string const &SymbolTable::intern(NamespaceId ns, std::string_view name)
+{
+  std::string const &namespaceName = getQualifiedName(ns);
+  if (namespaceName.empty())
+  {
+    return intern(name);
+  }
+
+  return intern(namespaceName + "::" + std::string(name));
+}
+
+std::string const &SymbolTable::internLocked(std::string_view name)
+{
+  auto finder = m_strings.find(name);
+  if (finder != m_strings.end())
+  {
+    return *finder;
+  }
+
+  return *m_strings.emplace(name).first;
+}
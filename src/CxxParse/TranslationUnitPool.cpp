@@ -0,0 +1,62 @@
+#include "CxxParse/TranslationUnitPool.hpp"
+
+TranslationUnitPool::TranslationUnitPool(uint32_t capacity)
+    : m_capacity(capacity)
+{
+  // Created up front, workers ask for it concurrently
+  m_indexHandle = m_index.get();
+}
+
+CXIndex TranslationUnitPool::getIndex()
+{
+  return m_indexHandle;
+}
+
+bool TranslationUnitPool::take(std::string const &path, std::vector<std::string> const &flags, ClangTranslationUnit &outUnit)
+{
+  std::scoped_lock lock(m_mutex);
+  auto finder = m_units.find(path);
+  if (finder == m_units.end())
+  {
+    return false;
+  }
+
+  // Parsed with other flags, reparsing would not give what a fresh parse gives
+  if (finder->second.flags != flags)
+  {
+    m_units.erase(finder);
+    return false;
+  }
+
+  outUnit = std::move(finder->second.unit);
+  m_units.erase(finder);
+  return true;
+}
+
+void TranslationUnitPool::put(std::string const &path, std::vector<std::string> const &flags, ClangTranslationUnit &&unit)
+{
+  if (m_capacity == 0 || unit.isNull())
+  {
+    return;
+  }
+
+  std::scoped_lock lock(m_mutex);
+  PooledUnit &pooled = m_units[path];
+  pooled.flags = flags;
+  pooled.unit = std::move(unit);
+  pooled.lastUse = ++m_useCounter;
+
+  while (m_units.size() > m_capacity)
+  {
+    auto oldest = m_units.begin();
+    for (auto it = m_units.begin(); it != m_units.end(); it++)
+    {
+      if (it->second.lastUse < oldest->second.lastUse)
+      {
+        oldest = it;
+      }
+    }
+
+    m_units.erase(oldest);
+  }
+}
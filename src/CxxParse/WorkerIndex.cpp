@@ -0,0 +1,24 @@
+#include "CxxParse/WorkerIndex.hpp"
+#include "CxxParse/Clang.hpp"
+
+namespace
+{
+  struct WorkerIndexHolder
+  {
+    // Members are destroyed in reverse order, the session refers to the index so it goes first
+    ClangIndex index;
+    ClangIndexAction action;
+  };
+
+  thread_local WorkerIndexHolder workerIndex;
+}
+
+CXIndex getWorkerIndex()
+{
+  return workerIndex.index.get();
+}
+
+CXIndexAction getWorkerIndexAction()
+{
+  return workerIndex.action.get(getWorkerIndex());
+}
@@ -0,0 +1,157 @@
+#include "FileHashCache.hpp"
+
+#include "ContentHash.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+namespace
+{
+  bool statEntry(std::string const &path, bool directory, uint64_t &outSize, uint64_t &outModified)
+  {
+    std::error_code error;
+    auto status = std::filesystem::status(path, error);
+    if (error || (directory ? !std::filesystem::is_directory(status) : !std::filesystem::is_regular_file(status)))
+    {
+      return false;
+    }
+
+    uint64_t size = directory ? 0 : std::filesystem::file_size(path, error);
+    if (error)
+    {
+      return false;
+    }
+
+    auto modified = std::filesystem::last_write_time(path, error);
+    if (error)
+    {
+      return false;
+    }
+
+    outSize = size;
+    outModified = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+    return true;
+  }
+}
+
+uint64_t getFileClockNow()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::filesystem::file_time_type::clock::now().time_since_epoch()).count();
+}
+
+#else
+
+namespace
+{
+  // A single stat call, where going through std::filesystem takes one per property
+  bool statEntry(std::string const &path, bool directory, uint64_t &outSize, uint64_t &outModified)
+  {
+    struct stat status;
+    if (::stat(path.c_str(), &status) != 0 || (directory ? !S_ISDIR(status.st_mode) : !S_ISREG(status.st_mode)))
+    {
+      return false;
+    }
+
+    outSize = directory ? 0 : (uint64_t)status.st_size;
+    outModified = (uint64_t)status.st_mtim.tv_sec * 1000000000ull + (uint64_t)status.st_mtim.tv_nsec;
+    return true;
+  }
+}
+
+uint64_t getFileClockNow()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+#endif
+
+bool statFile(std::string const &path, uint64_t &outSize, uint64_t &outModified)
+{
+  return statEntry(path, false, outSize, outModified);
+}
+
+bool statDirectory(std::string const &path, uint64_t &outModified)
+{
+  uint64_t size = 0;
+  return statEntry(path, true, size, outModified);
+}
+
+FileHashCache::FileHashCache()
+{
+}
+
+FileHashCache::FileHashCache(std::map<std::string, FileRecord> const &previousRecords)
+  : m_previousRecords(previousRecords)
+{
+}
+
+bool FileHashCache::getRecord(std::string const &path, FileRecord &outRecord)
+{
+  {
+    std::scoped_lock lock(m_mutex);
+    auto finder = m_records.find(path);
+    if (finder != m_records.end())
+    {
+      outRecord = finder->second;
+      return true;
+    }
+
+    if (m_missing.find(path) != m_missing.end())
+    {
+      return false;
+    }
+  }
+
+  // Stat and hash outside the lock, two threads racing on the same file compute the same record
+  FileRecord newRecord;
+  bool exists = statFile(path, newRecord.size, newRecord.modified);
+  if (exists)
+  {
+    // The previous records are never written after construction, so they are read without locking
+    auto previous = m_previousRecords.find(path);
+    if (previous != m_previousRecords.end() && previous->second.size == newRecord.size && previous->second.modified == newRecord.modified)
+    {
+      newRecord.hash = previous->second.hash;
+    }
+    else
+    {
+      // An edit in the same timestamp tick as this read would leave size and time as they are
+      uint64_t hashStart = getFileClockNow();
+      exists = hashFile(path, newRecord.hash);
+      if (newRecord.modified + RacyWindow >= hashStart)
+      {
+        newRecord.modified = 0;
+      }
+    }
+  }
+
+  std::scoped_lock lock(m_mutex);
+  if (!exists)
+  {
+    m_missing[path] = true;
+    return false;
+  }
+
+  m_records[path] = newRecord;
+  outRecord = newRecord;
+  return true;
+}
+
+bool FileHashCache::getHash(std::string const &path, uint64_t &outHash)
+{
+  FileRecord record;
+  if (!getRecord(path, record))
+  {
+    return false;
+  }
+
+  outHash = record.hash;
+  return true;
+}
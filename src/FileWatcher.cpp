@@ -0,0 +1,239 @@
+#include "FileWatcher.hpp"
+
+#include <WIR/Filesystem.hpp>
+
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+FileWatcher::FileWatcher(std::string const &rootDirectory)
+{
+  m_rootDirectory = wir::Directory(rootDirectory).path();
+
+#ifdef __linux__
+  m_inotify = inotify_init1(IN_CLOEXEC);
+  if (m_inotify < 0)
+  {
+    return;
+  }
+#endif
+
+  m_valid = true;
+  watchTree(m_rootDirectory);
+}
+
+void FileWatcher::addTree(std::string const &directory)
+{
+  if (m_valid && wir::Directory(directory).exist())
+  {
+    watchTree(wir::Directory(directory).path());
+  }
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+  if (m_inotify >= 0)
+  {
+    close(m_inotify);
+  }
+#endif
+}
+
+#ifdef __linux__
+
+void FileWatcher::watchTree(std::string const &directory)
+{
+  uint32_t const mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+
+  std::error_code error;
+  std::vector<std::string> directories = {directory};
+  for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+  {
+    if (it->is_directory(error))
+    {
+      directories.push_back(it->path().string());
+    }
+  }
+
+  for (auto const &watched : directories)
+  {
+    int descriptor = inotify_add_watch(m_inotify, watched.c_str(), mask);
+    if (descriptor >= 0)
+    {
+      m_watchedDirectories[descriptor] = watched;
+    }
+  }
+}
+
+bool FileWatcher::readEvents(FileWatchEvents &outEvents, int32_t timeoutMilliseconds)
+{
+  pollfd pending = {m_inotify, POLLIN, 0};
+  int ready = poll(&pending, 1, timeoutMilliseconds);
+  if (ready < 0)
+  {
+    return errno == EINTR;
+  }
+  else if (ready == 0)
+  {
+    return false;
+  }
+
+  alignas(inotify_event) char buffer[64 * 1024];
+  ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+  if (length <= 0)
+  {
+    return false;
+  }
+
+  for (char *current = buffer; current < buffer + length;)
+  {
+    inotify_event const *event = (inotify_event const *)current;
+    current += sizeof(inotify_event) + event->len;
+
+    auto watched = m_watchedDirectories.find(event->wd);
+    if (event->mask & IN_IGNORED)
+    {
+      if (watched != m_watchedDirectories.end())
+      {
+        m_watchedDirectories.erase(watched);
+      }
+      continue;
+    }
+
+    // The kernel dropped events, anything may have changed
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+      outEvents.treeChanged = true;
+      outEvents.overflowed = true;
+      continue;
+    }
+
+    if (watched == m_watchedDirectories.end() || event->len == 0)
+    {
+      continue;
+    }
+
+    std::string path = watched->second + "/" + event->name;
+    if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+    {
+      outEvents.treeChanged = true;
+    }
+
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+    {
+      watchTree(path);
+    }
+
+    outEvents.changedPaths.insert(path);
+  }
+
+  return true;
+}
+
+bool FileWatcher::waitForChanges(FileWatchEvents &outEvents, uint32_t settleMilliseconds)
+{
+  outEvents = FileWatchEvents();
+  while (outEvents.changedPaths.empty() && !outEvents.overflowed)
+  {
+    if (m_watchedDirectories.empty() || !readEvents(outEvents, -1))
+    {
+      return false;
+    }
+  }
+
+  while (readEvents(outEvents, int32_t(settleMilliseconds)))
+  {
+  }
+
+  return true;
+}
+
+#else
+
+void FileWatcher::watchTree(std::string const &directory)
+{
+  m_polledDirectories.push_back(directory);
+
+  // Only takes the stamps of what is there now, nothing has changed yet
+  FileWatchEvents ignored;
+  pollChanges(ignored);
+}
+
+bool FileWatcher::pollChanges(FileWatchEvents &outEvents)
+{
+  std::map<std::string, FileStamp> stamps;
+
+  for (auto const &directory : m_polledDirectories)
+  {
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+      if (!it->is_regular_file(error))
+      {
+        continue;
+      }
+
+      FileStamp &stamp = stamps[it->path().string()];
+      stamp.size = uint64_t(it->file_size(error));
+      stamp.modified = uint64_t(it->last_write_time(error).time_since_epoch().count());
+    }
+  }
+
+  bool changed = false;
+  for (auto const &stamp : stamps)
+  {
+    auto previous = m_stamps.find(stamp.first);
+    if (previous == m_stamps.end())
+    {
+      outEvents.treeChanged = true;
+    }
+
+    if (previous == m_stamps.end() || previous->second.size != stamp.second.size || previous->second.modified != stamp.second.modified)
+    {
+      outEvents.changedPaths.insert(stamp.first);
+      changed = true;
+    }
+  }
+
+  for (auto const &previous : m_stamps)
+  {
+    if (stamps.find(previous.first) == stamps.end())
+    {
+      outEvents.changedPaths.insert(previous.first);
+      outEvents.treeChanged = true;
+      changed = true;
+    }
+  }
+
+  m_stamps.swap(stamps);
+  return changed;
+}
+
+bool FileWatcher::waitForChanges(FileWatchEvents &outEvents, uint32_t settleMilliseconds)
+{
+  outEvents = FileWatchEvents();
+  while (!pollChanges(outEvents))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+
+  do
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(settleMilliseconds));
+  } while (pollChanges(outEvents));
+
+  return true;
+}
+
+#endif
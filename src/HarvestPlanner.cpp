@@ -0,0 +1,62 @@
+#include "HarvestPlanner.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+std::vector<HarvestPlan> planHarvest(std::vector<std::string> const &staleHeaders, BuildManifest const &manifest)
+{
+  std::set<std::string> stale(staleHeaders.begin(), staleHeaders.end());
+
+  // Stale project headers each header read last time, besides itself
+  std::map<std::string, std::vector<std::string>> coverage;
+  for (auto const &header : staleHeaders)
+  {
+    std::vector<std::string> &covered = coverage[header];
+    ManifestEntry const *entry = manifest.findEntry(header);
+    if (!entry)
+    {
+      continue;
+    }
+
+    for (auto const &dependency : entry->dependencies)
+    {
+      if (dependency != header && stale.find(dependency) != stale.end())
+      {
+        covered.push_back(dependency);
+      }
+    }
+  }
+
+  // Greedy set cover, the headers that pull in the most other stale headers become roots first
+  std::vector<std::string> candidates = staleHeaders;
+  std::stable_sort(candidates.begin(), candidates.end(), [&coverage](std::string const &a, std::string const &b) {
+    return coverage[a].size() > coverage[b].size();
+  });
+
+  std::vector<HarvestPlan> plans;
+  std::set<std::string> planned;
+  for (auto const &candidate : candidates)
+  {
+    if (planned.find(candidate) != planned.end())
+    {
+      continue;
+    }
+
+    HarvestPlan plan;
+    plan.rootHeader = candidate;
+    planned.insert(candidate);
+
+    for (auto const &covered : coverage[candidate])
+    {
+      if (planned.insert(covered).second)
+      {
+        plan.harvestedHeaders.push_back(covered);
+      }
+    }
+
+    plans.push_back(plan);
+  }
+
+  return plans;
+}
@@ -0,0 +1,303 @@
+#include "InheritanceGraph.hpp"
+
+#include "SerializableFile.hpp"
+
+#include <deque>
+
+namespace
+{
+  // Bump whenever the serialized layout changes, a mismatch starts from an empty graph
+  uint32_t const graphFormatVersion = 3;
+
+  void serializeEdges(wir::Stream &toStream, InheritanceGraph::EdgeMap const &edges)
+  {
+    toStream << (uint64_t)edges.size();
+    for (auto const &edge : edges)
+    {
+      toStream << edge.first;
+      toStream << (uint64_t)edge.second.size();
+      for (auto const &base : edge.second)
+      {
+        toStream << base;
+      }
+    }
+  }
+
+  void deserializeEdges(wir::Stream &fromStream, InheritanceGraph::EdgeMap &edges)
+  {
+    edges.clear();
+    uint64_t numClasses = 0;
+    fromStream >> numClasses;
+    for (uint64_t i = 0; i < numClasses; i++)
+    {
+      std::string className;
+      fromStream >> className;
+
+      std::set<std::string> &bases = edges[className];
+      uint64_t numBases = 0;
+      fromStream >> numBases;
+      for (uint64_t j = 0; j < numBases; j++)
+      {
+        std::string base;
+        fromStream >> base;
+        bases.insert(base);
+      }
+    }
+  }
+}
+
+bool InheritanceGraph::load(std::string const &path)
+{
+  InheritanceGraph loaded;
+  if (!readSerializable(path, loaded))
+  {
+    return false;
+  }
+
+  *this = loaded;
+  return true;
+}
+
+bool InheritanceGraph::save(std::string const &path) const
+{
+  return writeSerializable(path, *this);
+}
+
+void InheritanceGraph::learnFrom(HeaderFile const &header, bool includesFollowed)
+{
+  auto const &inheritMap = header.getInheritMap();
+
+  EdgeMap &ownEdges = m_headerEdges[header.getFilePath()];
+  ownEdges.clear();
+  for (auto const &classDecl : header.getClassDeclarations())
+  {
+    std::string const &className = classDecl.getFullyQualifiedName();
+    auto finder = inheritMap.find(className);
+    ownEdges[className] = finder != inheritMap.end() ? finder->second : std::set<std::string>();
+  }
+
+  if (!includesFollowed)
+  {
+    return;
+  }
+
+  EdgeMap &externalEdges = m_externalEdges[header.getFilePath()];
+  externalEdges.clear();
+  for (auto const &edge : inheritMap)
+  {
+    if (ownEdges.find(edge.first) == ownEdges.end())
+    {
+      externalEdges[edge.first] = edge.second;
+    }
+  }
+
+  if (externalEdges.empty())
+  {
+    m_externalEdges.erase(header.getFilePath());
+  }
+}
+
+void InheritanceGraph::prune(std::set<std::string> const &existingHeaders)
+{
+  for (auto it = m_headerEdges.begin(); it != m_headerEdges.end();)
+  {
+    if (existingHeaders.find(it->first) == existingHeaders.end())
+    {
+      it = m_headerEdges.erase(it);
+    }
+    else
+    {
+      it++;
+    }
+  }
+
+  for (auto it = m_externalEdges.begin(); it != m_externalEdges.end();)
+  {
+    if (existingHeaders.find(it->first) == existingHeaders.end())
+    {
+      it = m_externalEdges.erase(it);
+    }
+    else
+    {
+      it++;
+    }
+  }
+}
+
+std::string InheritanceGraph::resolveName(std::string const &writtenName, std::string const &derivedClass, std::set<std::string> const &knownClasses) const
+{
+  if (writtenName.compare(0, 2, "::") == 0)
+  {
+    return writtenName.substr(2);
+  }
+
+  // Walk outwards from the namespace of the derived class, like unqualified lookup would
+  std::string scope = derivedClass;
+  while (true)
+  {
+    std::string::size_type separator = scope.rfind("::");
+    if (separator == std::string::npos)
+    {
+      break;
+    }
+
+    scope = scope.substr(0, separator);
+    std::string candidate = scope + "::" + writtenName;
+    if (knownClasses.find(candidate) != knownClasses.end())
+    {
+      return candidate;
+    }
+  }
+
+  return writtenName;
+}
+
+void InheritanceGraph::resolve()
+{
+  m_resolvedEdges.clear();
+  m_classOrigins.clear();
+
+  // Headers that include the same outside class may have seen it at different times, what they saw together counts
+  EdgeMap externalEdges;
+  for (auto const &header : m_externalEdges)
+  {
+    for (auto const &edge : header.second)
+    {
+      externalEdges[edge.first].insert(edge.second.begin(), edge.second.end());
+    }
+  }
+
+  std::set<std::string> knownClasses = {"wir::Class"};
+  for (auto const &edge : externalEdges)
+  {
+    knownClasses.insert(edge.first);
+    knownClasses.insert(edge.second.begin(), edge.second.end());
+  }
+
+  for (auto const &header : m_headerEdges)
+  {
+    for (auto const &edge : header.second)
+    {
+      knownClasses.insert(edge.first);
+      m_classOrigins[edge.first] = header.first;
+    }
+  }
+
+  // External edges first, so whatever a project header declares takes precedence
+  for (auto const &edge : externalEdges)
+  {
+    if (m_classOrigins.find(edge.first) == m_classOrigins.end())
+    {
+      m_resolvedEdges[edge.first] = edge.second;
+    }
+  }
+
+  for (auto const &header : m_headerEdges)
+  {
+    for (auto const &edge : header.second)
+    {
+      std::set<std::string> &bases = m_resolvedEdges[edge.first];
+      for (auto const &base : edge.second)
+      {
+        bases.insert(resolveName(base, edge.first, knownClasses));
+      }
+    }
+  }
+}
+
+std::vector<std::string> InheritanceGraph::applyTo(HeaderFile &header) const
+{
+  EdgeMap reachable;
+  std::set<std::string> origins;
+
+  std::deque<std::string> pending;
+  for (auto const &classDecl : header.getClassDeclarations())
+  {
+    pending.push_back(classDecl.getFullyQualifiedName());
+  }
+
+  while (!pending.empty())
+  {
+    std::string className = pending.front();
+    pending.pop_front();
+
+    if (reachable.find(className) != reachable.end())
+    {
+      continue;
+    }
+
+    auto edge = m_resolvedEdges.find(className);
+    if (edge == m_resolvedEdges.end())
+    {
+      continue;
+    }
+
+    reachable[className] = edge->second;
+    pending.insert(pending.end(), edge->second.begin(), edge->second.end());
+
+    auto origin = m_classOrigins.find(className);
+    if (origin != m_classOrigins.end() && origin->second != header.getFilePath())
+    {
+      origins.insert(origin->second);
+    }
+  }
+
+  header.setInheritMap(reachable);
+  return std::vector<std::string>(origins.begin(), origins.end());
+}
+
+bool InheritanceGraph::serialize(wir::Stream &toStream) const
+{
+  toStream << graphFormatVersion;
+
+  toStream << (uint64_t)m_headerEdges.size();
+  for (auto const &header : m_headerEdges)
+  {
+    toStream << header.first;
+    serializeEdges(toStream, header.second);
+  }
+
+  toStream << (uint64_t)m_externalEdges.size();
+  for (auto const &header : m_externalEdges)
+  {
+    toStream << header.first;
+    serializeEdges(toStream, header.second);
+  }
+
+  return true;
+}
+
+bool InheritanceGraph::deserialize(wir::Stream &fromStream)
+{
+  m_headerEdges.clear();
+  m_externalEdges.clear();
+  m_resolvedEdges.clear();
+  m_classOrigins.clear();
+
+  uint32_t version = 0;
+  fromStream >> version;
+  if (version != graphFormatVersion)
+  {
+    return false;
+  }
+
+  uint64_t numHeaders = 0;
+  fromStream >> numHeaders;
+  for (uint64_t i = 0; i < numHeaders; i++)
+  {
+    std::string headerPath;
+    fromStream >> headerPath;
+    deserializeEdges(fromStream, m_headerEdges[headerPath]);
+  }
+
+  uint64_t numExternalHeaders = 0;
+  fromStream >> numExternalHeaders;
+  for (uint64_t i = 0; i < numExternalHeaders; i++)
+  {
+    std::string headerPath;
+    fromStream >> headerPath;
+    deserializeEdges(fromStream, m_externalEdges[headerPath]);
+  }
+
+  return true;
+}
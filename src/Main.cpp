@@ -1,14 +1,39 @@
 
+#include "BuildManifest.hpp"
+#include "ContentHash.hpp"
+#include "CompletionLatch.hpp"
 #include "CppGenerateTask.hpp"
 #include "CxxParse/HeaderFile.hpp"
+#include "CxxParse/PrecompiledPreamble.hpp"
+#include "CxxParse/TranslationUnitPool.hpp"
+#include "FileHashCache.hpp"
+#include "FileWatcher.hpp"
+#include "GenerateSettings.hpp"
+#include "HarvestPlanner.hpp"
+#include "InheritanceGraph.hpp"
+#include "OutputWriter.hpp"
+#include "ParseCache.hpp"
+#include "ParseWorkerPool.hpp"
+#include "ReflectionIndex.hpp"
+#include "SerializableFile.hpp"
+#include "ShardResult.hpp"
+#include "WorkStealingPool.hpp"
 
-#include <WIR/Async.hpp>
 #include <WIR/Error.hpp>
 #include <WIR/Filesystem.hpp>
 #include <WIR/String.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <system_error>
 #include <thread>
 #include <vector>
 
@@ -51,7 +76,429 @@ std::vector<Parameter> parseArguments(int argc, char **argv)
   return returner;
 }
 
-void generate(std::vector<Parameter> &parameters)
+/**
+ * Orders tasks longest-first (LPT), so the big headers do not end up as a tail that runs while the other workers sit idle.
+ * Expected costs come from the durations measured in previous runs; headers without history are estimated from their
+ * size, scaled by the average cost per byte of the headers that do have one.
+ */
+void sortLongestFirst(std::vector<CppGenerateTaskPtr> &tasks, BuildManifest const &manifest, FileHashCache &fileHashes)
+{
+  struct ExpectedCost
+  {
+    bool known = false;
+    uint64_t cost = 0;
+    uint64_t size = 0;
+  };
+
+  std::map<CppGenerateTask *, ExpectedCost> costs;
+  uint64_t knownCost = 0;
+  uint64_t knownSize = 0;
+  for (auto const &task : tasks)
+  {
+    ExpectedCost &expected = costs[task.get()];
+
+    FileRecord record;
+    if (fileHashes.getRecord(task->getInputFile(), record))
+    {
+      expected.size = record.size;
+    }
+
+    expected.known = manifest.getGenerateCost(task->getInputFile(), expected.cost);
+    if (expected.known)
+    {
+      knownCost += expected.cost;
+      knownSize += expected.size;
+    }
+  }
+
+  double costPerByte = (knownCost > 0 && knownSize > 0) ? double(knownCost) / double(knownSize) : 1.0;
+  for (auto &expected : costs)
+  {
+    if (!expected.second.known)
+    {
+      expected.second.cost = uint64_t(double(expected.second.size) * costPerByte);
+    }
+  }
+
+  std::stable_sort(tasks.begin(), tasks.end(), [&costs](CppGenerateTaskPtr const &a, CppGenerateTaskPtr const &b) {
+    return costs[a.get()].cost > costs[b.get()].cost;
+  });
+}
+
+/** Runs one stage of every task on the shared pool, returns once all of them have finished */
+void runTasks(std::vector<CppGenerateTaskPtr> const &tasks, WorkStealingPool &generatePool, std::function<void(CppGenerateTask &)> const &stage)
+{
+  // The full task count is known before anything is queued, so early finishers can never signal completion prematurely
+  CompletionLatch allJobsDone(tasks.size());
+  for (auto const &task : tasks)
+  {
+    CppGenerateTask *taskPtr = task.get();
+    generatePool.submit([taskPtr, &stage, &allJobsDone]() {
+      stage(*taskPtr);
+      allJobsDone.countDown();
+    });
+  }
+
+  allJobsDone.wait();
+}
+
+/**
+ * Parses every header once with each extraction engine, from a cold pool so each starts out with fresh sessions.
+ * Reports the wall time per engine and every header the engines disagree on.
+ */
+void benchmarkEngines(std::vector<std::string> const &headers, std::vector<std::string> const &cxxFlags, ParseOptions const &parseOptions, uint32_t numJobs)
+{
+  struct EngineRun
+  {
+    ParseEngine engine;
+    char const *name;
+    std::vector<std::vector<uint8_t>> results;
+    uint64_t duration = 0;
+  };
+
+  std::vector<EngineRun> runs = {{PE_Visitor, "visitor"}, {PE_Indexer, "indexer"}};
+  for (auto &run : runs)
+  {
+    ParseOptions options = parseOptions;
+    options.engine = run.engine;
+    run.results.resize(headers.size());
+
+    auto startTime = std::chrono::steady_clock::now();
+    {
+      CompletionLatch allJobsDone(headers.size());
+      WorkStealingPool benchmarkPool(numJobs);
+      for (size_t i = 0; i < headers.size(); i++)
+      {
+        benchmarkPool.submit([i, &headers, &cxxFlags, &options, &run, &allJobsDone]() {
+          serializeToBytes(HeaderFile(headers[i], cxxFlags, options), run.results[i]);
+          allJobsDone.countDown();
+        });
+      }
+
+      allJobsDone.wait();
+    }
+    run.duration = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    Log("Engine %s: %llu headers in %.3f s", run.name, (unsigned long long)headers.size(), double(run.duration) / 1000000.0);
+  }
+
+  uint64_t mismatches = 0;
+  for (size_t i = 0; i < headers.size(); i++)
+  {
+    if (runs[0].results[i] != runs[1].results[i])
+    {
+      LogWarning("Engines disagree on %s", headers[i].c_str());
+      mismatches++;
+    }
+  }
+
+  double speedup = runs[1].duration > 0 ? double(runs[0].duration) / double(runs[1].duration) : 0.0;
+  Log("Indexer speedup over visitor: %.2fx, %llu headers differ", speedup, (unsigned long long)mismatches);
+}
+
+/**
+ * Parses every header once on threads and once in worker processes, with the same number of each. Reports the wall
+ * time of both, every header they disagree on, and how often workers were recycled or crashed.
+ */
+void benchmarkWorkers(std::vector<std::string> const &headers, std::vector<std::string> const &cxxFlags, ParseOptions const &parseOptions, uint32_t numJobs, uint64_t recycleBytes, uint32_t timeoutSeconds)
+{
+  ParseWorkerPool workers(numJobs, recycleBytes, timeoutSeconds);
+  if (!workers.isValid())
+  {
+    LogError("Worker processes are not available, nothing to compare");
+    return;
+  }
+
+  struct WorkerRun
+  {
+    char const *name;
+    ParseWorkerPool *workers;
+    std::vector<std::vector<uint8_t>> results;
+    uint64_t duration = 0;
+  };
+
+  std::vector<WorkerRun> runs = {{"threads", nullptr}, {"processes", &workers}};
+  for (auto &run : runs)
+  {
+    run.results.resize(headers.size());
+
+    auto startTime = std::chrono::steady_clock::now();
+    {
+      CompletionLatch allJobsDone(headers.size());
+      WorkStealingPool benchmarkPool(numJobs);
+      for (size_t i = 0; i < headers.size(); i++)
+      {
+        benchmarkPool.submit([i, &headers, &cxxFlags, &parseOptions, &run, &allJobsDone]() {
+          if (run.workers)
+          {
+            serializeToBytes(run.workers->parse(headers[i], {}, cxxFlags, parseOptions)[headers[i]], run.results[i]);
+          }
+          else
+          {
+            serializeToBytes(HeaderFile(headers[i], cxxFlags, parseOptions), run.results[i]);
+          }
+          allJobsDone.countDown();
+        });
+      }
+
+      allJobsDone.wait();
+    }
+    run.duration = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    Log("Parsing on %s: %llu headers in %.3f s", run.name, (unsigned long long)headers.size(), double(run.duration) / 1000000.0);
+  }
+
+  uint64_t mismatches = 0;
+  for (size_t i = 0; i < headers.size(); i++)
+  {
+    if (runs[0].results[i] != runs[1].results[i])
+    {
+      LogWarning("Threads and processes disagree on %s", headers[i].c_str());
+      mismatches++;
+    }
+  }
+
+  double speedup = runs[1].duration > 0 ? double(runs[0].duration) / double(runs[1].duration) : 0.0;
+  Log("Process speedup over threads: %.2fx, %llu headers differ", speedup, (unsigned long long)mismatches);
+  Log("Workers spawned %llu, recycled %llu, crashed %llu, timed out %llu", (unsigned long long)workers.getNumSpawned(), (unsigned long long)workers.getNumRecycled(), (unsigned long long)workers.getNumCrashed(), (unsigned long long)workers.getNumTimedOut());
+}
+
+/** Escapes a path for a Make rule, which Ninja reads the same way */
+std::string escapeDepfilePath(std::string const &path)
+{
+  std::string escaped;
+  for (char c : path)
+  {
+    if (c == ' ' || c == '#')
+    {
+      escaped += '\\';
+    }
+    else if (c == '$')
+    {
+      escaped += '$';
+    }
+    escaped += c;
+  }
+
+  return escaped;
+}
+
+/** Brings a stamp up to date with its dependencies, creating it if it does not exist yet */
+void touchStamp(std::string const &stampPath, std::vector<std::string> const &dependencies)
+{
+  std::error_code error;
+  auto stampTime = std::filesystem::last_write_time(stampPath, error);
+  bool outdated = bool(error);
+  for (auto const &dependency : dependencies)
+  {
+    if (outdated)
+    {
+      break;
+    }
+    auto dependencyTime = std::filesystem::last_write_time(dependency, error);
+    outdated = !error && dependencyTime >= stampTime;
+  }
+
+  if (!outdated)
+  {
+    return;
+  }
+
+  bool changed = false;
+  if (!writeFileIfChanged(stampPath, "", changed))
+  {
+    LogError("Failed to write stamp (%s)", stampPath.c_str());
+    return;
+  }
+  std::filesystem::last_write_time(stampPath, std::filesystem::file_time_type::clock::now(), error);
+}
+
+/**
+ * Writes a depfile next to every generated source, listing everything its header was generated from. Every dependency
+ * also gets an empty rule, like -MP does, so Make does not fail on a header that has since been deleted.
+ * Depfiles that did not change are left alone.
+ *
+ * Generated sources whose content did not change keep their old modification time, so the depfile names a stamp,
+ * <output>.stamp, which is brought up to date on every run instead. The build rule should list the stamp as its
+ * output, next to the generated source; with Ninja, set restat = 1 on that rule so an unchanged generated source does
+ * not recompile what depends on it.
+ */
+void writeDepfiles(BuildManifest const &manifest, std::vector<std::string> const &inputHeaders, PrecompiledPreamble const &preamble)
+{
+  for (auto const &header : inputHeaders)
+  {
+    ManifestEntry const *entry = manifest.findEntry(header);
+    if (!entry)
+    {
+      continue;
+    }
+
+    // The build system has no notion of the preamble, headers parsed on top of it depend on everything it read
+    std::vector<std::string> dependencies = entry->dependencies;
+    if (entry->preambleHash != 0)
+    {
+      dependencies.insert(dependencies.end(), preamble.getIncludes().begin(), preamble.getIncludes().end());
+    }
+
+    std::string stampPath = entry->outputFile + ".stamp";
+    touchStamp(stampPath, dependencies);
+
+    std::string depfile = escapeDepfilePath(stampPath) + ":";
+    for (auto const &dependency : dependencies)
+    {
+      depfile += " \\\n  " + escapeDepfilePath(dependency);
+    }
+    depfile += "\n";
+
+    for (auto const &dependency : dependencies)
+    {
+      depfile += "\n" + escapeDepfilePath(dependency) + ":\n";
+    }
+
+    std::string depfilePath = entry->outputFile + ".d";
+    bool changed = false;
+    if (!writeFileIfChanged(depfilePath, depfile, changed))
+    {
+      LogError("Failed to write depfile (%s)", depfilePath.c_str());
+    }
+  }
+}
+
+/**
+ * Finds every input header under the input directory, and records the directories it went through, so the next run
+ * can tell from their modification times alone whether the result still holds.
+ */
+InputTree walkInputTree(std::string const &rootPath)
+{
+  InputTree tree;
+  tree.rootPath = rootPath;
+
+  // A directory that changed shortly before the walk is not trusted next time
+  uint64_t walkStart = getFileClockNow();
+
+  std::vector<std::string> directories = {rootPath};
+  std::error_code error;
+  for (std::filesystem::recursive_directory_iterator it(rootPath, error), end; !error && it != end; it.increment(error))
+  {
+    std::error_code typeError;
+    if (it->is_directory(typeError))
+    {
+      directories.push_back(it->path().string());
+    }
+    else if (it->path().extension() == ".hpp")
+    {
+      tree.headers.push_back(wir::File(it->path().string()).path());
+    }
+  }
+  std::sort(tree.headers.begin(), tree.headers.end());
+
+  // An incomplete walk is used for this run, but never trusted by the next
+  if (error)
+  {
+    return tree;
+  }
+
+  for (auto const &directory : directories)
+  {
+    uint64_t modified = 0;
+    if (!statDirectory(directory, modified) || modified + RacyWindow >= walkStart)
+    {
+      modified = 0;
+    }
+    tree.directories[directory] = modified;
+  }
+
+  return tree;
+}
+
+/**
+ * Hands what the shards of a sharded run parsed to the tasks of their headers. Headers no shard parsed successfully,
+ * or that changed since, stay unparsed and are parsed by this run. Returns false if the shards can not be merged into
+ * this run.
+ */
+bool adoptShardResults(std::vector<std::string> const &shardPaths, std::vector<CppGenerateTaskPtr> const &tasks, std::string const &inputRoot, uint64_t optionsHash, std::shared_ptr<SymbolTable> const &symbols, BuildManifest &manifest, FileHashCache &hashes)
+{
+  std::map<std::string, CppGenerateTask *> tasksByInput;
+  for (auto const &task : tasks)
+  {
+    tasksByInput[task->getInputFile()] = task.get();
+  }
+
+  std::set<uint32_t> mergedShards;
+  uint32_t numShards = 0;
+  uint64_t numChanged = 0;
+  for (auto const &shardPath : shardPaths)
+  {
+    ShardResult shard;
+    shard.symbols = symbols;
+    if (!shard.load(shardPath))
+    {
+      LogError("Could not read shard result (%s)", shardPath.c_str());
+      return false;
+    }
+
+    if (shard.optionsHash != optionsHash)
+    {
+      LogError("Shard result %s was parsed with different flags or parse options", shardPath.c_str());
+      return false;
+    }
+
+    if ((numShards != 0 && shard.numShards != numShards) || !mergedShards.insert(shard.shardIndex).second)
+    {
+      LogError("Shard result %s does not belong with the others (shard %u/%u)", shardPath.c_str(), shard.shardIndex, shard.numShards);
+      return false;
+    }
+    numShards = shard.numShards;
+
+    for (auto &entry : shard.entries)
+    {
+      // The shard may have seen a different tree, or the same one before it was edited
+      if (!entry.matchesHashes(inputRoot, hashes))
+      {
+        numChanged++;
+        continue;
+      }
+      entry.makePathsAbsolute(inputRoot);
+
+      // Headers deleted since the shard ran have no task
+      auto finder = tasksByInput.find(entry.inputFile);
+      if (finder == tasksByInput.end())
+      {
+        continue;
+      }
+
+      finder->second->adoptHeader(std::move(entry.header), false);
+      if (entry.duration > 0)
+      {
+        manifest.setGenerateCost(entry.inputFile, entry.duration);
+      }
+    }
+  }
+
+  if (mergedShards.size() != numShards)
+  {
+    LogWarning("Merging %u of %u shards, the headers of the missing ones are parsed here", (uint32_t)mergedShards.size(), numShards);
+  }
+
+  if (numChanged > 0)
+  {
+    LogWarning("%llu headers or their includes differ from what the shards parsed, they are parsed here", (unsigned long long)numChanged);
+  }
+
+  return true;
+}
+
+/** State a resident process carries from one run to the next */
+struct WatchSession
+{
+  std::shared_ptr<TranslationUnitPool> units;
+
+  // The input headers found by the last directory walk, walked again once the tree changed
+  std::vector<std::string> inputHeaders;
+  bool inputHeadersKnown = false;
+};
+
+void generate(std::vector<Parameter> &parameters, WatchSession *session = nullptr)
 {
   if (parameters.size() < 2)
   {
@@ -62,6 +509,27 @@ void generate(std::vector<Parameter> &parameters)
 
   std::string outputPath = "./generated";
   std::string inputPath = "";
+  std::string cachePath = "";
+  bool useCache = true;
+  ParseOptions parseOptions;
+  uint32_t numJobs = WorkStealingPool::getDefaultNumWorkers();
+  bool usePreamble = false;
+  double preambleThreshold = 0.25;
+  bool useHarvest = false;
+  bool runEngineBenchmark = false;
+  bool useWorkerProcesses = false;
+  uint64_t workerRecycleMb = 2048;
+  uint32_t workerTimeoutSeconds = 600;
+  bool runWorkerBenchmark = false;
+  bool usePrefilter = false;
+  bool writeDepfile = false;
+  bool planOnly = false;
+
+  // Shard shardIndex of numShards only parses its part of the headers, merging combines the results into outputs
+  uint32_t shardIndex = 0;
+  uint32_t numShards = 0;
+  std::string shardResultPath;
+  std::vector<std::string> mergePaths;
 
   bool skipFirst = false;
   for (auto param : parameters)
@@ -80,6 +548,152 @@ void generate(std::vector<Parameter> &parameters)
     {
       outputPath = param.value;
     }
+    if (param.name == "cachePath")
+    {
+      cachePath = param.value;
+    }
+    if (param.name == "noCache")
+    {
+      useCache = param.value != "true";
+    }
+    if (param.name == "parseProfile")
+    {
+      if (param.value == "full")
+      {
+        parseOptions.profile = PP_Full;
+      }
+      else if (param.value == "fast")
+      {
+        parseOptions.profile = PP_Fast;
+      }
+      else
+      {
+        LogWarning("Unknown parse profile \"%s\", expected fast or full", param.value.c_str());
+      }
+    }
+    if (param.name == "engine")
+    {
+      if (param.value == "indexer")
+      {
+        parseOptions.engine = PE_Indexer;
+      }
+      else if (param.value == "visitor")
+      {
+        parseOptions.engine = PE_Visitor;
+      }
+      else
+      {
+        LogWarning("Unknown engine \"%s\", expected visitor or indexer", param.value.c_str());
+      }
+    }
+    if (param.name == "benchmarkEngines")
+    {
+      runEngineBenchmark = param.value == "true";
+    }
+    if (param.name == "workerProcesses")
+    {
+      useWorkerProcesses = param.value == "true";
+    }
+    if (param.name == "workerRecycleMb")
+    {
+      int64_t requestedMb = std::atoll(param.value.c_str());
+      if (requestedMb < 1)
+      {
+        LogWarning("Invalid worker recycle threshold \"%s\", using %llu MB", param.value.c_str(), (unsigned long long)workerRecycleMb);
+      }
+      else
+      {
+        workerRecycleMb = uint64_t(requestedMb);
+      }
+    }
+    if (param.name == "workerTimeout")
+    {
+      // In seconds, 0 waits for as long as a parse takes
+      int32_t requestedTimeout = std::atoi(param.value.c_str());
+      if (requestedTimeout < 0)
+      {
+        LogWarning("Invalid worker timeout \"%s\", using %u s", param.value.c_str(), workerTimeoutSeconds);
+      }
+      else
+      {
+        workerTimeoutSeconds = uint32_t(requestedTimeout);
+      }
+    }
+    if (param.name == "benchmarkWorkers")
+    {
+      runWorkerBenchmark = param.value == "true";
+    }
+    if (param.name == "singleFile")
+    {
+      parseOptions.singleFile = param.value == "true";
+    }
+    if (param.name == "pch")
+    {
+      usePreamble = param.value == "true";
+    }
+    if (param.name == "pchThreshold")
+    {
+      preambleThreshold = std::atof(param.value.c_str());
+    }
+    if (param.name == "harvest")
+    {
+      useHarvest = param.value == "true";
+    }
+    if (param.name == "prefilter")
+    {
+      usePrefilter = param.value == "true";
+    }
+    if (param.name == "depfile")
+    {
+      writeDepfile = param.value == "true";
+    }
+    if (param.name == "plan")
+    {
+      planOnly = param.value == "true";
+    }
+    if (param.name == "shard")
+    {
+      std::string::size_type separator = param.value.find('/');
+      int32_t requestedIndex = std::atoi(param.value.substr(0, separator).c_str());
+      int32_t requestedShards = separator == std::string::npos ? 0 : std::atoi(param.value.substr(separator + 1).c_str());
+      if (requestedShards < 1 || requestedIndex < 0 || requestedIndex >= requestedShards)
+      {
+        LogError("Invalid shard \"%s\", expected i/N with i counting from 0", param.value.c_str());
+        return;
+      }
+
+      shardIndex = uint32_t(requestedIndex);
+      numShards = uint32_t(requestedShards);
+    }
+    if (param.name == "shardResult")
+    {
+      shardResultPath = param.value;
+    }
+    if (param.name == "merge")
+    {
+      std::string::size_type start = 0;
+      while (start <= param.value.size())
+      {
+        std::string::size_type end = std::min(param.value.find(',', start), param.value.size());
+        if (end > start)
+        {
+          mergePaths.push_back(param.value.substr(start, end - start));
+        }
+        start = end + 1;
+      }
+    }
+    if (param.name == "jobs")
+    {
+      int32_t requestedJobs = std::atoi(param.value.c_str());
+      if (requestedJobs < 1)
+      {
+        LogWarning("Invalid job count \"%s\", using %u", param.value.c_str(), numJobs);
+      }
+      else
+      {
+        numJobs = uint32_t(requestedJobs);
+      }
+    }
     if (param.name == "include")
     {
       extraArgs.push_back("-I");
@@ -98,8 +712,79 @@ void generate(std::vector<Parameter> &parameters)
     return;
   }
 
+  if (session)
+  {
+    parseOptions.units = session->units;
+  }
+
+  // Names are interned per run, the table goes away with the last header of this run
+  parseOptions.symbols = std::make_shared<SymbolTable>();
+
+  // Workers keep their own translation units, the warm ones of a watch session live in this process
+  if (session && useWorkerProcesses)
+  {
+    LogWarning("Watch mode keeps translation units in this process, ignoring --workerProcesses");
+    useWorkerProcesses = false;
+  }
+
   outputPath = wir::Directory(outputPath).path();
 
+  if (cachePath.size() == 0)
+  {
+    cachePath = outputPath + "/.wircache";
+  }
+
+  if (numShards > 0 && !mergePaths.empty())
+  {
+    LogError("A run either parses a shard or merges shards, not both");
+    return;
+  }
+
+  // Every header a shard or merge covers is regenerated, and ruling out headers would leave holes in the results
+  bool sharded = numShards > 0 || !mergePaths.empty();
+  if (sharded && usePrefilter)
+  {
+    LogWarning("Sharded runs do not use the prefilter, ignoring --prefilter");
+    usePrefilter = false;
+  }
+
+  if (numShards > 0 && shardResultPath.empty())
+  {
+    shardResultPath = wir::format("%s/shard-%u-of-%u", wir::Directory(cachePath).path().c_str(), shardIndex, numShards);
+  }
+
+  // Staleness is decided from the manifest of the previous run, never from timestamps alone. Until something turns
+  // out to be stale, it and the metadata of the last preamble are the only files read; nothing else is loaded, and
+  // neither is libclang.
+  std::string manifestPath = wir::Directory(cachePath).path() + "/manifest";
+  BuildManifest manifest;
+  manifest.load(manifestPath);
+  FileHashCache fileHashes(manifest.getFileRecords());
+  bool manifestChanged = false;
+
+  // Headers parsed on top of a preamble are stale once anything it read has changed, whether or not this run uses one
+  PrecompiledPreamble lastPreamble;
+  uint64_t preambleHash = lastPreamble.loadCurrent(cachePath, fileHashes) ? lastPreamble.getContentHash() : 0;
+
+  uint64_t flagsHash = BuildManifest::computeFlagsHash(extraArgs, parseOptions);
+
+  // Headers the prefilter ruled out are recorded against the index they were scanned with, so they are scanned again
+  // once it changes
+  std::string reflectionIndexPath = wir::Directory(cachePath).path() + "/reflection";
+  ReflectionIndex reflectionIndex;
+  if (usePrefilter)
+  {
+    reflectionIndex.load(reflectionIndexPath);
+  }
+  uint64_t reflectionIndexHash = reflectionIndex.getHash();
+  uint64_t skippedFlagsHash = hashBytes(&reflectionIndexHash, sizeof(reflectionIndexHash), flagsHash);
+  bool prefilterReady = usePrefilter && !reflectionIndex.isEmpty();
+
+  GenerateSettings settings;
+  settings.cxxFlags = extraArgs;
+  settings.parseOptions = parseOptions;
+  settings.fileHashes = &fileHashes;
+
   wir::Directory inputDir(inputPath);
   if (!inputDir.exist())
   {
@@ -108,36 +793,60 @@ void generate(std::vector<Parameter> &parameters)
   }
 
   std::vector<std::string> inputHeaders;
-  inputDir.iterate(true, [&](wir::FilesystemEntry *entry) -> void {
-    wir::File *file = dynamic_cast<wir::File *>(entry);
-    if (!file)
+  if (session && session->inputHeadersKnown)
+  {
+    inputHeaders = session->inputHeaders;
+  }
+  else
+  {
+    // The tree is only walked again once a directory in it changed
+    if (!manifest.getInputHeaders(inputDir.path(), inputHeaders))
     {
-      return;
+      InputTree inputTree = walkInputTree(inputDir.path());
+      inputHeaders = inputTree.headers;
+      manifest.setInputTree(inputTree);
+      manifestChanged = true;
     }
 
-    if (file->extension() != ".hpp")
+    if (session)
     {
-      return;
+      session->inputHeaders = inputHeaders;
+      session->inputHeadersKnown = true;
     }
-
-    inputHeaders.push_back(file->path());
-  });
+  }
 
   if (inputHeaders.size() == 0)
   {
-    Log("No input headers found");
+    // An empty plan is still a valid plan
+    if (!planOnly)
+    {
+      Log("No input headers found");
+    }
+    return;
+  }
+
+  if (runEngineBenchmark)
+  {
+    benchmarkEngines(inputHeaders, extraArgs, parseOptions, numJobs);
+    return;
+  }
+
+  if (runWorkerBenchmark)
+  {
+    benchmarkWorkers(inputHeaders, extraArgs, parseOptions, numJobs, workerRecycleMb * 1024 * 1024, workerTimeoutSeconds);
     return;
   }
-  std::recursive_mutex generateTasksMutex;
-  std::set<CppGenerateTaskPtr> generateTasks;
-  std::atomic_bool allJobsDone{false};
 
-  int32_t threadPoolSize = int32_t(std::thread::hardware_concurrency()) - 2;
-  if (threadPoolSize < 1)
+  // A shard never touches the manifest, the inheritance graph or the outputs, so it only ever sees its own headers
+  if (numShards > 0)
   {
-    threadPoolSize = 1;
+    inputHeaders = selectShardHeaders(inputHeaders, inputDir.path(), shardIndex, numShards, fileHashes);
+    if (!planOnly)
+    {
+      Log("Shard %u of %u parses %llu headers", shardIndex, numShards, (unsigned long long)inputHeaders.size());
+    }
   }
-  wir::AsyncContext generateContext(threadPoolSize);
+  std::vector<CppGenerateTaskPtr> allTasks;
 
   for (auto header : inputHeaders)
   {
@@ -148,73 +857,553 @@ void generate(std::vector<Parameter> &parameters)
     wir::File outputFile(outputFilePath);
     wir::File inputFile(header);
 
-    uint64_t lastChanged = inputFile.lastWriteTime();
-    uint64_t lastGenerated = outputFile.exist() ? outputFile.lastWriteTime() : 0;
+    bool stale = manifest.isStale(inputFile.path(), outputFile.path(), flagsHash, preambleHash, fileHashes);
+    if (usePrefilter)
+    {
+      // Headers the index has not seen yet are parsed once, their classes might be what other headers derive from
+      stale = !reflectionIndex.hasHeader(inputFile.path()) || (stale && manifest.isStale(inputFile.path(), outputFile.path(), skippedFlagsHash, preambleHash, fileHashes));
+    }
 
-    if (lastChanged > lastGenerated)
+    if (stale || sharded)
     {
-      CppGenerateTaskPtr newTask = std::make_shared<CppGenerateTask>(inputFile.path(), outputFile.path(), extraArgs);
-      newTask->onCompleted += [newTask, &generateTasksMutex, &generateTasks, &allJobsDone]() {
-        std::scoped_lock lock(generateTasksMutex);
-        generateTasks.erase(newTask);
-        if (generateTasks.empty())
-        {
-          allJobsDone.store(true);
-        }
-      };
+      allTasks.push_back(std::make_shared<CppGenerateTask>(inputFile.path(), outputFile.path(), &settings));
+    }
+  }
 
-      std::scoped_lock lock(generateTasksMutex);
-      generateTasks.insert(newTask);
-      generateContext.queueTask(newTask);
+  // A dry run for the build system, which can leave the generator out entirely when nothing is listed
+  if (planOnly)
+  {
+    for (auto const &task : allTasks)
+    {
+      std::cout << task->getInputFile() << "\n";
     }
+    std::cout.flush();
+    return;
   }
 
-  if (generateTasks.size() == 0)
+  // A shard with nothing to parse still writes its, empty, result
+  if (allTasks.size() == 0 && numShards == 0)
   {
     Log("No input headers needs update");
+    manifestChanged = manifest.prune(std::set<std::string>(inputHeaders.begin(), inputHeaders.end())) || manifestChanged;
+    if (manifestChanged)
+    {
+      manifest.save(manifestPath);
+    }
+
+    // Depfiles of an earlier run without --depfile, or deleted by the build system, are written even on a no-op run
+    if (writeDepfile)
+    {
+      writeDepfiles(manifest, inputHeaders, lastPreamble);
+    }
     return;
   }
 
-  wir::Timer timer;
-  while (true)
+  std::unique_ptr<ParseCache> parseCache;
+  if (useCache)
+  {
+    parseCache = std::make_unique<ParseCache>(cachePath);
+  }
+  settings.parseCache = parseCache.get();
+
+  std::string inheritanceGraphPath = wir::Directory(cachePath).path() + "/inheritance";
+  InheritanceGraph inheritanceGraph;
+  inheritanceGraph.load(inheritanceGraphPath);
+
+  // Workers only render, the writer thread commits the outputs to disk behind them
+  OutputWriter outputWriter;
+  settings.outputWriter = &outputWriter;
+
+  std::unique_ptr<ParseWorkerPool> parseWorkers;
+  if (useWorkerProcesses)
+  {
+    parseWorkers = std::make_unique<ParseWorkerPool>(numJobs, workerRecycleMb * 1024 * 1024, workerTimeoutSeconds);
+    if (parseWorkers->isValid())
+    {
+      settings.parseWorkers = parseWorkers.get();
+    }
+    else
+    {
+      LogWarning("Worker processes are not available, parsing on threads");
+      parseWorkers.reset();
+    }
+  }
+
+  // One set of worker threads serves every stage, each stage only waits on its own latch
+  WorkStealingPool generatePool(numJobs);
+
+  if (!mergePaths.empty())
+  {
+    if (!adoptShardResults(mergePaths, allTasks, inputDir.path(), ShardResult::computeOptionsHash(extraArgs, parseOptions), parseOptions.symbols, manifest, fileHashes))
+    {
+      return;
+    }
+
+    // What the shards parsed is cached here as well, so the next run on this host starts out warm
+    std::vector<CppGenerateTaskPtr> adoptedTasks;
+    for (auto const &task : allTasks)
+    {
+      if (task->isParsed())
+      {
+        adoptedTasks.push_back(task);
+      }
+    }
+
+    runTasks(adoptedTasks, generatePool, [](CppGenerateTask &task) { task.storeAdopted(); });
+    Log("Merged %llu headers from %llu shards", (unsigned long long)adoptedTasks.size(), (unsigned long long)mergePaths.size());
+  }
+
+  if (usePrefilter && !prefilterReady)
+  {
+    Log("The reflection index is empty, nothing is ruled out until it has been built up by this run");
+  }
+  else if (prefilterReady)
+  {
+    std::vector<std::string> staleHeaders;
+    for (auto const &task : allTasks)
+    {
+      staleHeaders.push_back(task->getInputFile());
+    }
+
+    std::set<std::string> candidates = reflectionIndex.scan(staleHeaders);
+    for (auto const &task : allTasks)
+    {
+      if (candidates.find(task->getInputFile()) == candidates.end())
+      {
+        task->skipParse();
+      }
+    }
+
+    Log("Prefilter ruled out %llu of %llu headers", (unsigned long long)(allTasks.size() - candidates.size()), (unsigned long long)allTasks.size());
+  }
+
+  if (usePreamble && parseOptions.singleFile)
+  {
+    LogWarning("A precompiled preamble has no use when parsing without includes, ignoring --pch");
+  }
+  else if (usePreamble && parseWorkers)
+  {
+    LogWarning("Worker processes parse without the precompiled preamble, ignoring --pch");
+  }
+  else if (usePreamble)
+  {
+    // Picked from what the inputs included on previous runs, so the first run goes without
+    std::vector<std::vector<std::string>> directIncludes;
+    for (auto const &header : inputHeaders)
+    {
+      ManifestEntry const *entry = manifest.findEntry(header);
+      if (entry)
+      {
+        directIncludes.push_back(entry->directIncludes);
+      }
+    }
+
+    auto preambleHeaders = PrecompiledPreamble::selectHeaders(directIncludes, inputDir.path() + "/", preambleThreshold);
+    auto preamble = std::make_shared<PrecompiledPreamble>();
+    if (preamble->prepare(cachePath, preambleHeaders, extraArgs, fileHashes))
+    {
+      settings.parseOptions.preamble = preamble;
+    }
+  }
+
+  Log("Generating %llu headers on %u workers", (unsigned long long)allTasks.size(), numJobs);
+
+  sortLongestFirst(allTasks, manifest, fileHashes);
+
+  if (useHarvest && parseOptions.singleFile)
+  {
+    LogWarning("Parsing without includes leaves nothing to harvest from, ignoring --harvest");
+    useHarvest = false;
+  }
+
+  // Harvest plans assume none of the headers are parsed yet
+  if (useHarvest && !mergePaths.empty())
+  {
+    useHarvest = false;
+  }
+
+  if (parseOptions.singleFile || useHarvest || sharded)
+  {
+    std::vector<CppGenerateTaskPtr> parseTasks = allTasks;
+    if (!mergePaths.empty())
+    {
+      parseTasks.erase(std::remove_if(parseTasks.begin(), parseTasks.end(), [](CppGenerateTaskPtr const &task) { return task->isParsed(); }), parseTasks.end());
+      if (!parseTasks.empty())
+      {
+        Log("%llu headers were not parsed by any shard, parsing them here", (unsigned long long)parseTasks.size());
+      }
+    }
+    else if (useHarvest)
+    {
+      // Only the roots are parsed, in the same longest-first order, and collect the other headers along the way
+      std::map<std::string, CppGenerateTaskPtr> tasksByInput;
+      std::vector<std::string> staleHeaders;
+      for (auto const &task : allTasks)
+      {
+        if (!task->wasSkipped())
+        {
+          tasksByInput[task->getInputFile()] = task;
+          staleHeaders.push_back(task->getInputFile());
+        }
+      }
+
+      std::set<std::string> roots;
+      for (auto const &plan : planHarvest(staleHeaders, manifest))
+      {
+        std::vector<CppGenerateTask *> harvestedTasks;
+        for (auto const &harvested : plan.harvestedHeaders)
+        {
+          harvestedTasks.push_back(tasksByInput[harvested].get());
+        }
+
+        tasksByInput[plan.rootHeader]->setHarvestedTasks(harvestedTasks);
+        roots.insert(plan.rootHeader);
+      }
+
+      parseTasks.erase(std::remove_if(parseTasks.begin(), parseTasks.end(), [&roots](CppGenerateTaskPtr const &task) { return roots.find(task->getInputFile()) == roots.end(); }), parseTasks.end());
+      Log("Harvesting %llu headers from %llu translation units", (unsigned long long)allTasks.size(), (unsigned long long)parseTasks.size());
+    }
+
+    runTasks(parseTasks, generatePool, [](CppGenerateTask &task) { task.parse(); });
+
+    if (useHarvest)
+    {
+      // Headers their root no longer includes, or that it failed to parse, get a translation unit of their own
+      std::vector<CppGenerateTaskPtr> remainingTasks;
+      for (auto const &task : allTasks)
+      {
+        if (!task->isParsed())
+        {
+          remainingTasks.push_back(task);
+        }
+      }
+
+      runTasks(remainingTasks, generatePool, [](CppGenerateTask &task) { task.parse(); });
+    }
+
+    if (numShards > 0)
+    {
+      ShardResult shard;
+      shard.optionsHash = ShardResult::computeOptionsHash(extraArgs, parseOptions);
+      shard.shardIndex = shardIndex;
+      shard.numShards = numShards;
+      for (auto const &task : allTasks)
+      {
+        ShardEntry &entry = shard.entries.emplace_back();
+        entry.inputFile = task->getInputFile();
+        entry.duration = (task->wasCacheHit() || task->wasHarvested()) ? 0 : task->getDuration();
+        entry.header = task->takeParsedHeader();
+        entry.makePathsRelative(inputDir.path());
+
+        // Headers that can not be read back are left to the merge, which would not be able to tell if they changed
+        if (!entry.recordHashes(inputDir.path(), fileHashes))
+        {
+          shard.entries.pop_back();
+        }
+      }
+
+      if (!shard.save(shardResultPath))
+      {
+        LogError("Failed to write the shard result (%s)", shardResultPath.c_str());
+        return;
+      }
+
+      Log("Wrote the result of shard %u of %u to %s", shardIndex, numShards, shardResultPath.c_str());
+      return;
+    }
+
+    if (parseOptions.singleFile)
+    {
+      // Headers parsed without includes only know their own bases by name, so everything is parsed before the
+      // inheritance graph is updated and resolved, and only then emitted
+      for (auto const &task : allTasks)
+      {
+        if (task->getGeneratedStatus() != GS_Error && !task->wasSkipped())
+        {
+          inheritanceGraph.learnFrom(task->getParsedHeader(), false);
+        }
+      }
+
+      inheritanceGraph.prune(std::set<std::string>(inputHeaders.begin(), inputHeaders.end()));
+      inheritanceGraph.resolve();
+
+      for (auto const &task : allTasks)
+      {
+        task->resolveInheritance(inheritanceGraph);
+      }
+    }
+
+    runTasks(allTasks, generatePool, [](CppGenerateTask &task) { task.emit(); });
+  }
+  else
+  {
+    runTasks(allTasks, generatePool, [](CppGenerateTask &task) { task.execute(); });
+  }
+
+  outputWriter.flush();
+
+  if (parseWorkers)
+  {
+    Log("Workers spawned %llu, recycled %llu, crashed %llu, timed out %llu", (unsigned long long)parseWorkers->getNumSpawned(), (unsigned long long)parseWorkers->getNumRecycled(), (unsigned long long)parseWorkers->getNumCrashed(), (unsigned long long)parseWorkers->getNumTimedOut());
+  }
+
+  // Outputs that came out identical were left alone, the manifest still records them as up to date
+  uint64_t numWritten = 0;
+  uint64_t numUnchanged = 0;
+  for (auto const &task : allTasks)
+  {
+    if (task->getGeneratedStatus() == GS_Completed)
+    {
+      (task->wasOutputChanged() ? numWritten : numUnchanged)++;
+    }
+  }
+
+  Log("Wrote %llu generated sources, %llu were unchanged", (unsigned long long)numWritten, (unsigned long long)numUnchanged);
+
+  if (!parseOptions.singleFile)
+  {
+    // Full parses keep the graph current, and are the only source for classes declared outside the project
+    for (auto const &task : allTasks)
+    {
+      if (task->getGeneratedStatus() == GS_Completed && !task->wasSkipped())
+      {
+        inheritanceGraph.learnFrom(task->getParsedHeader(), true);
+      }
+    }
+
+    inheritanceGraph.prune(std::set<std::string>(inputHeaders.begin(), inputHeaders.end()));
+  }
+
+  if (!inheritanceGraph.save(inheritanceGraphPath))
+  {
+    LogError("Failed to save the inheritance graph (%s)", inheritanceGraphPath.c_str());
+  }
+
+  for (auto const &task : allTasks)
+  {
+    if (task->wasSkipped())
+    {
+      reflectionIndex.learnSkipped(task->getInputFile());
+    }
+    else if (task->getGeneratedStatus() == GS_Completed)
+    {
+      reflectionIndex.learnFrom(task->getParsedHeader());
+    }
+  }
+
+  reflectionIndex.prune(std::set<std::string>(inputHeaders.begin(), inputHeaders.end()));
+  if (usePrefilter && !reflectionIndex.save(reflectionIndexPath))
   {
-    if (timer.seconds() <= 0.25)
+    LogError("Failed to save the reflection index (%s)", reflectionIndexPath.c_str());
+  }
+
+  reflectionIndexHash = reflectionIndex.getHash();
+  skippedFlagsHash = hashBytes(&reflectionIndexHash, sizeof(reflectionIndexHash), flagsHash);
+
+  for (auto const &task : allTasks)
+  {
+    if (task->wasSkipped())
     {
+      if (task->getGeneratedStatus() == GS_Completed)
+      {
+        manifest.update(task->getInputFile(), task->getOutputFile(), skippedFlagsHash, {task->getInputFile()}, {}, 0, fileHashes);
+      }
+      else
+      {
+        manifest.remove(task->getInputFile());
+      }
       continue;
     }
 
-    generateContext.tick();
+    // A cache hit says nothing about how long a real parse takes, keep the previous measurement; the same goes for
+    // headers harvested from another translation unit
+    if (!task->wasCacheHit() && !task->wasHarvested())
+    {
+      manifest.setGenerateCost(task->getInputFile(), task->getDuration());
+    }
 
-    timer.reset();
-    if (allJobsDone.load())
+    if (task->getGeneratedStatus() != GS_Completed)
     {
-      break;
+      manifest.remove(task->getInputFile());
+      continue;
     }
+
+    std::vector<std::string> dependencies = {task->getInputFile()};
+    auto const &includes = task->getParsedHeader().getIncludes();
+    auto const &extraDependencies = task->getExtraDependencies();
+    dependencies.insert(dependencies.end(), includes.begin(), includes.end());
+    dependencies.insert(dependencies.end(), extraDependencies.begin(), extraDependencies.end());
+    manifest.update(task->getInputFile(), task->getOutputFile(), flagsHash, dependencies, task->getParsedHeader().getDirectIncludes(), task->getParsedHeader().getPreambleHash(), fileHashes);
+  }
+
+  manifest.prune(std::set<std::string>(inputHeaders.begin(), inputHeaders.end()));
+  if (!manifest.save(manifestPath))
+  {
+    LogError("Failed to save the build manifest (%s)", manifestPath.c_str());
+  }
+
+  if (writeDepfile)
+  {
+    writeDepfiles(manifest, inputHeaders, settings.parseOptions.preamble ? *settings.parseOptions.preamble : lastPreamble);
   }
 }
 
+/**
+ * Stays resident after a first full run, and runs again whenever something in the input tree changes. Translation
+ * units are kept between runs, so a header that changed is reparsed on top of the preamble of its includes. What
+ * needs regenerating is still decided by the build manifest, so headers outside the tree are picked up on the next run.
+ */
+void watch(std::vector<Parameter> &parameters)
+{
+  std::string inputPath = "";
+  std::string outputPath = "./generated";
+  std::string cachePath = "";
+  uint32_t numUnits = 128;
+  std::vector<std::string> includePaths;
+  for (auto const &param : parameters)
+  {
+    if (param.name == "include")
+    {
+      includePaths.push_back(param.value);
+    }
+    if (param.name == "inputPath")
+    {
+      inputPath = param.value;
+    }
+    if (param.name == "outputPath")
+    {
+      outputPath = param.value;
+    }
+    if (param.name == "cachePath")
+    {
+      cachePath = param.value;
+    }
+    if (param.name == "watchUnits")
+    {
+      numUnits = uint32_t(std::max(0, std::atoi(param.value.c_str())));
+    }
+  }
+
+  WatchSession session;
+  session.units = std::make_shared<TranslationUnitPool>(numUnits);
+  generate(parameters, &session);
+
+  if (inputPath.size() == 0)
+  {
+    return;
+  }
+
+  FileWatcher watcher(inputPath);
+  if (!watcher.isValid())
+  {
+    LogError("Could not watch the input path (%s)", inputPath.c_str());
+    return;
+  }
+
+  // Headers on the include paths, such as the framework's base classes, are dependencies of the outputs too
+  for (auto const &includePath : includePaths)
+  {
+    watcher.addTree(includePath);
+  }
+
+  // Our own outputs may live inside the watched tree, writing them must not trigger another run
+  std::vector<std::string> ignoredPrefixes = {wir::Directory(outputPath).path() + "/"};
+  if (cachePath.size() > 0)
+  {
+    ignoredPrefixes.push_back(wir::Directory(cachePath).path() + "/");
+  }
+
+  Log("Watching %s for changes", wir::Directory(inputPath).path().c_str());
+
+  FileWatchEvents events;
+  while (watcher.waitForChanges(events))
+  {
+    uint64_t numChanged = 0;
+    for (auto const &changedPath : events.changedPaths)
+    {
+      bool ignored = false;
+      for (auto const &prefix : ignoredPrefixes)
+      {
+        ignored = ignored || changedPath.compare(0, prefix.size(), prefix) == 0;
+      }
+
+      numChanged += ignored ? 0 : 1;
+    }
+
+    if (numChanged == 0 && !events.overflowed)
+    {
+      continue;
+    }
+
+    if (events.treeChanged)
+    {
+      session.inputHeadersKnown = false;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    generate(parameters, &session);
+    Log("Regenerated after %llu changes in %.3f s", (unsigned long long)numChanged, double(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count()) / 1000000.0);
+  }
+
+  LogError("Stopped watching %s", inputPath.c_str());
+}
+
 int main(int argc, char **argv)
 {
+  // Worker processes answer parse requests on their socket and never see the usual parameters
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::string(argv[i]) == "--parseWorker")
+    {
+      return ParseWorkerPool::runWorker();
+    }
+  }
+
   try
   {
 
     int32_t numThreads = std::thread::hardware_concurrency();
 
-    Log("WIR Static Code Generator");
-    Log("---");
-    Log("Recognized %u hardware threads.", numThreads);
-    Log("");
-
     auto parameters = parseArguments(argc, argv);
 
-    Log("Runtime parameters:");
-    for (auto param : parameters)
+    bool watchMode = false;
+    bool planOnly = false;
+    for (auto const &param : parameters)
+    {
+      if (param.name == "watch")
+      {
+        watchMode = param.value == "true";
+      }
+      if (param.name == "plan")
+      {
+        planOnly = param.value == "true";
+      }
+    }
+
+    // The plan is read by the build system, nothing else may end up next to it
+    if (!planOnly)
     {
-      Log("%s = %s", param.name.c_str(), param.value.c_str());
+      Log("WIR Static Code Generator");
+      Log("---");
+      Log("Recognized %u hardware threads.", numThreads);
+      Log("");
+
+      Log("Runtime parameters:");
+      for (auto param : parameters)
+      {
+        Log("%s = %s", param.name.c_str(), param.value.c_str());
+      }
+      Log("");
     }
-    Log("");
 
-    generate(parameters);
+    if (watchMode)
+    {
+      watch(parameters);
+    }
+    else
+    {
+      generate(parameters);
+    }
   }
   catch (std::exception e)
   {
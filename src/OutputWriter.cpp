@@ -0,0 +1,102 @@
+#include "OutputWriter.hpp"
+#include "SerializableFile.hpp"
+
+#include <filesystem>
+#include <system_error>
+
+OutputWriter::OutputWriter()
+{
+  m_thread = std::thread([this]() { writerLoop(); });
+}
+
+OutputWriter::~OutputWriter()
+{
+  {
+    std::scoped_lock lock(m_mutex);
+    m_stopping = true;
+  }
+  m_queueCondition.notify_one();
+
+  m_thread.join();
+}
+
+void OutputWriter::submit(std::string const &path, std::string &&content, Completion onComplete)
+{
+  Output output{path, std::filesystem::path(path).parent_path().string(), std::move(content), std::move(onComplete)};
+  {
+    std::scoped_lock lock(m_mutex);
+    m_queue.push_back(std::move(output));
+    m_pending++;
+  }
+  m_queueCondition.notify_one();
+}
+
+void OutputWriter::flush()
+{
+  std::unique_lock lock(m_mutex);
+  m_flushCondition.wait(lock, [this]() { return m_pending == 0; });
+}
+
+void OutputWriter::writerLoop()
+{
+  std::vector<Output> batch;
+  while (true)
+  {
+    {
+      std::unique_lock lock(m_mutex);
+      m_queueCondition.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty())
+      {
+        return;
+      }
+
+      // Take everything at once, workers keep queueing into the emptied vector while this batch is written
+      batch.swap(m_queue);
+    }
+
+    writeBatch(batch);
+
+    {
+      std::scoped_lock lock(m_mutex);
+      m_pending -= batch.size();
+    }
+    m_flushCondition.notify_all();
+
+    batch.clear();
+  }
+}
+
+void OutputWriter::writeBatch(std::vector<Output> &batch)
+{
+  std::set<std::string> directories;
+  for (auto const &output : batch)
+  {
+    if (m_createdDirectories.find(output.directory) == m_createdDirectories.end())
+    {
+      directories.insert(output.directory);
+    }
+  }
+
+  for (auto const &directory : directories)
+  {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!error)
+    {
+      m_createdDirectories.insert(directory);
+    }
+  }
+
+  for (auto &output : batch)
+  {
+    // A directory that could not be created is tried again by the write itself, which then reports the failure
+    bool createPath = m_createdDirectories.find(output.directory) == m_createdDirectories.end();
+
+    bool changed = false;
+    bool written = writeFileIfChanged(output.path, output.content, changed, createPath);
+
+    // The buffer is no longer needed, release it before the completion runs
+    std::string().swap(output.content);
+    output.onComplete(written, changed);
+  }
+}
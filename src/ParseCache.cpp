@@ -0,0 +1,146 @@
+#include "ParseCache.hpp"
+
+#include "ContentHash.hpp"
+#include "CxxParse/PrecompiledPreamble.hpp"
+#include "SerializableFile.hpp"
+
+#include <WIR/Filesystem.hpp>
+
+#include <filesystem>
+
+namespace
+{
+  // Bump whenever the serialized layout of HeaderFile changes
+  std::string const cacheFormatVersion = "wircodegen-parsecache-6";
+
+  class ParseCacheEntry : public wir::Serializable
+  {
+  public:
+    ParseCacheEntry() = default;
+
+    explicit ParseCacheEntry(std::shared_ptr<SymbolTable> const &symbols)
+        : header(symbols)
+    {
+    }
+
+    virtual bool serialize(wir::Stream &toStream) const override
+    {
+      toStream << (uint64_t)includeHashes.size();
+      for (auto const &includeHash : includeHashes)
+      {
+        toStream << includeHash;
+      }
+
+      toStream << (storedHeader ? *storedHeader : header);
+      return true;
+    }
+
+    virtual bool deserialize(wir::Stream &fromStream) override
+    {
+      includeHashes.clear();
+      uint64_t numHashes = readCount(fromStream);
+      for (uint64_t i = 0; i < numHashes; i++)
+      {
+        uint64_t newHash = 0;
+        fromStream >> newHash;
+        includeHashes.push_back(newHash);
+      }
+
+      fromStream >> header;
+      return includeHashes.size() == header.getIncludes().size();
+    }
+
+    // Content hashes of header.getIncludes(), in the same order
+    std::vector<uint64_t> includeHashes;
+
+    // Written instead of header when set, so storing does not copy the header
+    HeaderFile const *storedHeader = nullptr;
+    HeaderFile header;
+  };
+}
+
+ParseCache::ParseCache(std::string const &cacheDirectory)
+{
+  m_directory = wir::Directory(cacheDirectory).path();
+  m_environmentHash = hashStrings({cacheFormatVersion, HeaderFile::getParserVersion()});
+}
+
+std::string ParseCache::computeKey(std::string const &headerPath, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options, FileHashCache &hashes) const
+{
+  uint64_t contentHash = 0;
+  if (!hashes.getHash(headerPath, contentHash))
+  {
+    return "";
+  }
+
+  uint64_t key = hashBytes(&contentHash, sizeof(contentHash), m_environmentHash);
+  key = hashStrings(HeaderFile::getCompilerFlags(cxxFlagsExtra), key);
+  key = hashString(options.getKey(), key);
+
+  // A parse on top of the preamble leaves out what the preamble read, so it only stands in for parses on the same one
+  if (options.preamble && !options.singleFile && !options.preamble->contains(wir::File(headerPath).path()))
+  {
+    uint64_t preambleHash = options.preamble->getContentHash();
+    key = hashBytes(&preambleHash, sizeof(preambleHash), key);
+  }
+
+  // The path is part of the key, since it ends up in the generated #include and the declaration origin checks
+  key = hashString(wir::File(headerPath).path(), key);
+
+  return hashToString(key);
+}
+
+bool ParseCache::load(std::string const &key, std::shared_ptr<SymbolTable> const &symbols, HeaderFile &outHeader, FileHashCache &hashes) const
+{
+  ParseCacheEntry entry(symbols);
+  std::string const entryPath = getEntryPath(key);
+  if (!readSerializable(entryPath, entry) || !entry.header.isValid() || entry.includeHashes.size() != entry.header.getIncludes().size())
+  {
+    // A truncated or garbled entry is a miss, drop it so the next store replaces it instead of it being read again
+    std::error_code error;
+    std::filesystem::remove(entryPath, error);
+    return false;
+  }
+
+  auto const &includes = entry.header.getIncludes();
+  for (uint64_t i = 0; i < includes.size(); i++)
+  {
+    uint64_t currentHash = 0;
+    if (!hashes.getHash(includes[i], currentHash) || currentHash != entry.includeHashes[i])
+    {
+      return false;
+    }
+  }
+
+  outHeader = std::move(entry.header);
+  return true;
+}
+
+bool ParseCache::store(std::string const &key, HeaderFile const &header, FileHashCache &hashes) const
+{
+  if (!header.isValid())
+  {
+    return false;
+  }
+
+  ParseCacheEntry entry;
+  entry.storedHeader = &header;
+  for (auto const &include : header.getIncludes())
+  {
+    uint64_t includeHash = 0;
+    if (!hashes.getHash(include, includeHash))
+    {
+      return false;
+    }
+
+    entry.includeHashes.push_back(includeHash);
+  }
+
+  return writeSerializable(getEntryPath(key), entry);
+}
+
+std::string ParseCache::getEntryPath(std::string const &key) const
+{
+  // Fan out on the first two characters to keep directories small
+  return m_directory + "/" + key.substr(0, 2) + "/" + key + ".header";
+}
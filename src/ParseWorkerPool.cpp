@@ -0,0 +1,568 @@
+#include "ParseWorkerPool.hpp"
+#include "SerializableFile.hpp"
+
+#include <WIR/Error.hpp>
+#include <WIR/Filesystem.hpp>
+#include <WIR/String.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  class ParseRequest : public wir::Serializable
+  {
+  public:
+    virtual bool serialize(wir::Stream &toStream) const override
+    {
+      toStream << rootHeaderPath;
+      toStream << (uint64_t)harvestedHeaderPaths.size();
+      for (auto const &path : harvestedHeaderPaths)
+      {
+        toStream << path;
+      }
+
+      toStream << (uint64_t)cxxFlagsExtra.size();
+      for (auto const &flag : cxxFlagsExtra)
+      {
+        toStream << flag;
+      }
+
+      toStream << (uint8_t)options.profile;
+      toStream << (uint8_t)options.engine;
+      toStream << options.singleFile;
+      return true;
+    }
+
+    virtual bool deserialize(wir::Stream &fromStream) override
+    {
+      fromStream >> rootHeaderPath;
+
+      harvestedHeaderPaths.clear();
+      uint64_t numHarvested = 0;
+      fromStream >> numHarvested;
+      for (uint64_t i = 0; i < numHarvested; i++)
+      {
+        fromStream >> harvestedHeaderPaths.emplace_back();
+      }
+
+      cxxFlagsExtra.clear();
+      uint64_t numFlags = 0;
+      fromStream >> numFlags;
+      for (uint64_t i = 0; i < numFlags; i++)
+      {
+        fromStream >> cxxFlagsExtra.emplace_back();
+      }
+
+      uint8_t profile = 0;
+      uint8_t engine = 0;
+      fromStream >> profile;
+      fromStream >> engine;
+      fromStream >> options.singleFile;
+      options.profile = (ParseProfile)profile;
+      options.engine = (ParseEngine)engine;
+      return true;
+    }
+
+    std::string rootHeaderPath;
+    std::vector<std::string> harvestedHeaderPaths;
+    std::vector<std::string> cxxFlagsExtra;
+    ParseOptions options;
+  };
+
+  class ParseResponse : public wir::Serializable
+  {
+  public:
+    virtual bool serialize(wir::Stream &toStream) const override
+    {
+      toStream << residentBytes;
+      toStream << (uint64_t)headers.size();
+      for (auto const &header : headers)
+      {
+        toStream << header.first;
+        toStream << header.second;
+      }
+      return true;
+    }
+
+    virtual bool deserialize(wir::Stream &fromStream) override
+    {
+      fromStream >> residentBytes;
+
+      headers.clear();
+      uint64_t numHeaders = 0;
+      fromStream >> numHeaders;
+      for (uint64_t i = 0; i < numHeaders; i++)
+      {
+        std::string path;
+        HeaderFile header(symbols);
+        fromStream >> path;
+        fromStream >> header;
+        headers.emplace(path, std::move(header));
+      }
+      return true;
+    }
+
+    // Of the worker, after the parse
+    uint64_t residentBytes = 0;
+    std::map<std::string, HeaderFile> headers;
+
+    // Where the supervisor interns the names of the headers it receives
+    std::shared_ptr<SymbolTable> symbols;
+  };
+
+  std::map<std::string, HeaderFile> makeFailed(std::string const &rootHeaderPath, std::vector<std::string> const &harvestedHeaderPaths, std::string const &reason)
+  {
+    std::map<std::string, HeaderFile> headers;
+    std::string rootPath = wir::File(rootHeaderPath).path();
+    headers.emplace(rootPath, HeaderFile::makeFailed(rootPath, reason));
+    for (auto const &harvestedHeaderPath : harvestedHeaderPaths)
+    {
+      std::string harvestedPath = wir::File(harvestedHeaderPath).path();
+      headers.emplace(harvestedPath, HeaderFile::makeFailed(harvestedPath, reason));
+    }
+
+    return headers;
+  }
+
+#ifdef __linux__
+  using Deadline = std::chrono::steady_clock::time_point;
+
+  // Far more than the headers of any translation unit serialize to, a size past this means the stream is garbled
+  uint64_t const MaxMessageBytes = 1ull << 30;
+
+  /** Waits until the descriptor is ready for the given poll events, returns false once the deadline has passed */
+  bool waitReady(int descriptor, short events, Deadline const *deadline)
+  {
+    if (!deadline)
+    {
+      return true;
+    }
+
+    while (true)
+    {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now()).count();
+      if (remaining <= 0)
+      {
+        return false;
+      }
+
+      pollfd descriptorPoll{descriptor, events, 0};
+      int numReady = poll(&descriptorPoll, 1, int(std::min<int64_t>(remaining, INT32_MAX)));
+      if (numReady < 0 && errno != EINTR)
+      {
+        return false;
+      }
+
+      // Hangups and errors count as ready too, the read or write reports them
+      if (numReady > 0)
+      {
+        return true;
+      }
+    }
+  }
+
+  bool writeAll(int descriptor, void const *data, size_t size, Deadline const *deadline = nullptr)
+  {
+    uint8_t const *bytes = (uint8_t const *)data;
+    while (size > 0)
+    {
+      if (!waitReady(descriptor, POLLOUT, deadline))
+      {
+        return false;
+      }
+
+      // A worker that died must show up as a failed write, not as a SIGPIPE taking the supervisor with it. With a
+      // deadline, a worker that stopped reading must not block the write either.
+      ssize_t written = send(descriptor, bytes, size, MSG_NOSIGNAL | (deadline ? MSG_DONTWAIT : 0));
+      if (written < 0 && (errno == EINTR || (deadline && (errno == EAGAIN || errno == EWOULDBLOCK))))
+      {
+        continue;
+      }
+      if (written <= 0)
+      {
+        return false;
+      }
+
+      bytes += written;
+      size -= size_t(written);
+    }
+
+    return true;
+  }
+
+  bool readAll(int descriptor, void *data, size_t size, Deadline const *deadline = nullptr)
+  {
+    uint8_t *bytes = (uint8_t *)data;
+    while (size > 0)
+    {
+      if (!waitReady(descriptor, POLLIN, deadline))
+      {
+        return false;
+      }
+
+      ssize_t numRead = recv(descriptor, bytes, size, 0);
+      if (numRead < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (numRead <= 0)
+      {
+        return false;
+      }
+
+      bytes += numRead;
+      size -= size_t(numRead);
+    }
+
+    return true;
+  }
+
+  // Messages are their size followed by a serialized object
+  bool writeMessage(int descriptor, std::vector<uint8_t> const &bytes, Deadline const *deadline = nullptr)
+  {
+    uint64_t size = bytes.size();
+    return writeAll(descriptor, &size, sizeof(size), deadline) && writeAll(descriptor, bytes.data(), bytes.size(), deadline);
+  }
+
+  bool readMessage(int descriptor, std::vector<uint8_t> &outBytes, Deadline const *deadline = nullptr)
+  {
+    uint64_t size = 0;
+    if (!readAll(descriptor, &size, sizeof(size), deadline) || size > MaxMessageBytes)
+    {
+      return false;
+    }
+
+    outBytes.resize(size);
+    return readAll(descriptor, outBytes.data(), outBytes.size(), deadline);
+  }
+
+  uint64_t getResidentBytes()
+  {
+    // Pages in total, then resident pages
+    std::ifstream statm("/proc/self/statm");
+    uint64_t totalPages = 0;
+    uint64_t residentPages = 0;
+    if (!(statm >> totalPages >> residentPages))
+    {
+      return 0;
+    }
+
+    return residentPages * uint64_t(sysconf(_SC_PAGESIZE));
+  }
+
+  std::string describeExit(int status)
+  {
+    if (WIFSIGNALED(status))
+    {
+      return wir::format("killed by signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+    }
+
+    if (WIFEXITED(status))
+    {
+      return wir::format("exited with code %d", WEXITSTATUS(status));
+    }
+
+    return "lost";
+  }
+#endif
+}
+
+ParseWorkerPool::ParseWorkerPool(uint32_t numWorkers, uint64_t recycleBytes, uint32_t timeoutSeconds)
+{
+  m_recycleBytes = recycleBytes;
+  m_timeoutSeconds = timeoutSeconds;
+
+  // Address space runs well ahead of resident memory, libclang maps far more than it touches. The limit only stops a
+  // runaway parse, the recycle threshold is what keeps workers small in normal use.
+  m_addressSpaceBytes = recycleBytes * 4;
+
+#ifdef __linux__
+  char executablePath[4096];
+  ssize_t pathLength = readlink("/proc/self/exe", executablePath, sizeof(executablePath) - 1);
+  if (pathLength <= 0)
+  {
+    LogError("Could not find the executable to start parse workers from");
+    return;
+  }
+  m_executablePath.assign(executablePath, size_t(pathLength));
+
+  // All started up front, so their startup is not paid for by the first parses
+  m_workers.resize(numWorkers);
+  for (uint32_t i = 0; i < numWorkers; i++)
+  {
+    if (!spawn(m_workers[i]))
+    {
+      LogError("Could not start parse worker %u: %s", i, strerror(errno));
+      m_workers.resize(i);
+      break;
+    }
+  }
+#endif
+}
+
+ParseWorkerPool::~ParseWorkerPool()
+{
+  for (auto &worker : m_workers)
+  {
+    retire(worker, false);
+  }
+}
+
+bool ParseWorkerPool::isValid() const
+{
+  std::scoped_lock lock(m_mutex);
+  return !m_workers.empty();
+}
+
+uint64_t ParseWorkerPool::getNumSpawned() const
+{
+  std::scoped_lock lock(m_mutex);
+  return m_numSpawned;
+}
+
+uint64_t ParseWorkerPool::getNumRecycled() const
+{
+  std::scoped_lock lock(m_mutex);
+  return m_numRecycled;
+}
+
+uint64_t ParseWorkerPool::getNumCrashed() const
+{
+  std::scoped_lock lock(m_mutex);
+  return m_numCrashed;
+}
+
+uint64_t ParseWorkerPool::getNumTimedOut() const
+{
+  std::scoped_lock lock(m_mutex);
+  return m_numTimedOut;
+}
+
+bool ParseWorkerPool::spawn(Worker &worker)
+{
+#ifdef __linux__
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+  {
+    return false;
+  }
+
+  // The supervisor runs other threads, so the child only makes async-signal-safe calls until it has exec'd. Workers
+  // are started again instead of forked copies, and can be replaced at any point during a run.
+  std::string workerFlag = "--parseWorker";
+  char *arguments[] = {m_executablePath.data(), workerFlag.data(), nullptr};
+
+  rlimit addressSpace;
+  addressSpace.rlim_cur = m_addressSpaceBytes > 0 ? rlim_t(m_addressSpaceBytes) : RLIM_INFINITY;
+  addressSpace.rlim_max = addressSpace.rlim_cur;
+
+  pid_t pid = fork();
+  if (pid < 0)
+  {
+    close(sockets[0]);
+    close(sockets[1]);
+    return false;
+  }
+
+  if (pid == 0)
+  {
+    // The copy dup2 makes is kept open through exec, every other descriptor of the supervisor is closed by it
+    if (sockets[1] == WorkerDescriptor ? fcntl(sockets[1], F_SETFD, 0) != 0 : dup2(sockets[1], WorkerDescriptor) < 0)
+    {
+      _exit(127);
+    }
+
+    // Set before exec so it holds from the worker's first allocation; a parse past it fails to allocate and takes
+    // only this worker down
+    if (m_addressSpaceBytes > 0 && setrlimit(RLIMIT_AS, &addressSpace) != 0)
+    {
+      _exit(127);
+    }
+
+    execv(arguments[0], arguments);
+    _exit(127);
+  }
+
+  close(sockets[1]);
+  worker.pid = pid;
+  worker.socket = sockets[0];
+  m_numSpawned++;
+  return true;
+#else
+  return false;
+#endif
+}
+
+int ParseWorkerPool::retire(Worker &worker, bool kill)
+{
+  int status = 0;
+#ifdef __linux__
+  if (worker.pid < 0)
+  {
+    return status;
+  }
+
+  // A worker exits once its socket is closed, one that misbehaved is not waited for
+  if (kill)
+  {
+    ::kill(worker.pid, SIGKILL);
+  }
+  close(worker.socket);
+
+  while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR)
+  {
+  }
+
+  worker.pid = -1;
+  worker.socket = -1;
+#endif
+  return status;
+}
+
+std::map<std::string, HeaderFile> ParseWorkerPool::parse(std::string const &rootHeaderPath, std::vector<std::string> const &harvestedHeaderPaths, std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options)
+{
+#ifdef __linux__
+  ParseRequest request;
+  request.rootHeaderPath = rootHeaderPath;
+  request.harvestedHeaderPaths = harvestedHeaderPaths;
+  request.cxxFlagsExtra = cxxFlagsExtra;
+  request.options.profile = options.profile;
+  request.options.engine = options.engine;
+  request.options.singleFile = options.singleFile;
+
+  std::vector<uint8_t> requestBytes;
+  serializeToBytes(request, requestBytes);
+
+  // A busy worker belongs to the thread that took it, nothing else touches it until it is handed back
+  Worker *worker = nullptr;
+  bool started = true;
+  {
+    std::unique_lock lock(m_mutex);
+    if (m_workers.empty())
+    {
+      return makeFailed(rootHeaderPath, harvestedHeaderPaths, "No parse workers are running");
+    }
+
+    auto isIdle = [](Worker const &candidate) { return !candidate.busy; };
+    m_idleCondition.wait(lock, [this, &isIdle]() { return std::any_of(m_workers.begin(), m_workers.end(), isIdle); });
+    worker = &*std::find_if(m_workers.begin(), m_workers.end(), isIdle);
+    worker->busy = true;
+
+    // Replaces a worker that was retired or died
+    if (worker->pid < 0)
+    {
+      started = spawn(*worker);
+    }
+  }
+
+  std::vector<uint8_t> responseBytes;
+  ParseResponse response;
+  response.symbols = options.symbols;
+
+  Deadline deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_timeoutSeconds);
+  Deadline const *requestDeadline = m_timeoutSeconds > 0 ? &deadline : nullptr;
+  bool answered = started && writeMessage(worker->socket, requestBytes, requestDeadline) && readMessage(worker->socket, responseBytes, requestDeadline) && deserializeFromBytes(responseBytes, response);
+  bool timedOut = started && !answered && requestDeadline && std::chrono::steady_clock::now() >= deadline;
+
+  std::string failure;
+  bool recycled = false;
+  if (!started)
+  {
+    failure = wir::format("Could not start a parse worker: %s", strerror(errno));
+  }
+  else if (timedOut)
+  {
+    retire(*worker, true);
+    failure = wir::format("The parse worker did not answer within %u s and was killed", m_timeoutSeconds);
+  }
+  else if (!answered)
+  {
+    int status = retire(*worker, true);
+    failure = wir::format("The parse worker %s while parsing this header", describeExit(status).c_str());
+  }
+  else if (response.residentBytes > m_recycleBytes)
+  {
+    retire(*worker, false);
+    recycled = true;
+  }
+
+  {
+    std::scoped_lock lock(m_mutex);
+    worker->busy = false;
+    m_numCrashed += (started && !answered && !timedOut) ? 1 : 0;
+    m_numTimedOut += timedOut ? 1 : 0;
+    m_numRecycled += recycled ? 1 : 0;
+  }
+  m_idleCondition.notify_one();
+
+  if (!failure.empty())
+  {
+    LogError("%s (%s)", failure.c_str(), rootHeaderPath.c_str());
+    return makeFailed(rootHeaderPath, harvestedHeaderPaths, failure);
+  }
+
+  return std::move(response.headers);
+#else
+  return makeFailed(rootHeaderPath, harvestedHeaderPaths, "Parse workers are not supported on this platform");
+#endif
+}
+
+int ParseWorkerPool::runWorker()
+{
+#ifdef __linux__
+  std::vector<uint8_t> bytes;
+  while (readMessage(WorkerDescriptor, bytes))
+  {
+    ParseRequest request;
+    if (!deserializeFromBytes(bytes, request))
+    {
+      return 1;
+    }
+
+    ParseResponse response;
+    try
+    {
+      if (request.harvestedHeaderPaths.empty())
+      {
+        // Keyed by the path as requested, which is what callers look it up by
+        response.headers.emplace(request.rootHeaderPath, HeaderFile(request.rootHeaderPath, request.cxxFlagsExtra, request.options));
+      }
+      else
+      {
+        response.headers = HeaderFile::harvest(request.rootHeaderPath, request.harvestedHeaderPaths, request.cxxFlagsExtra, request.options);
+      }
+    }
+    catch (std::exception &e)
+    {
+      response.headers = makeFailed(request.rootHeaderPath, request.harvestedHeaderPaths, e.what());
+    }
+
+    response.residentBytes = getResidentBytes();
+
+    bytes.clear();
+    if (!serializeToBytes(response, bytes) || !writeMessage(WorkerDescriptor, bytes))
+    {
+      return 1;
+    }
+  }
+
+  // The supervisor closed the socket
+  return 0;
+#else
+  return 1;
+#endif
+}
@@ -0,0 +1,556 @@
+#include "ReflectionIndex.hpp"
+
+#include "ContentHash.hpp"
+#include "SerializableFile.hpp"
+
+#include <string_view>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  // Bump whenever the serialized layout changes, a mismatch starts from an empty index
+  uint32_t const reflectionIndexFormatVersion = 1;
+
+  /** Read-only view of a whole file, memory mapped where available */
+  class MappedFile
+  {
+  public:
+    MappedFile(std::string const &path)
+    {
+#ifndef _WIN32
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        return;
+      }
+
+      struct stat info;
+      if (fstat(fd, &info) == 0)
+      {
+        m_valid = true;
+        if (info.st_size > 0)
+        {
+          void *mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+          if (mapped != MAP_FAILED)
+          {
+            m_mapped = mapped;
+            m_view = std::string_view((char const *)mapped, size_t(info.st_size));
+          }
+          else
+          {
+            m_valid = false;
+          }
+        }
+      }
+
+      close(fd);
+#else
+      std::ifstream file(path, std::ios_base::binary);
+      if (!file.is_open())
+      {
+        return;
+      }
+
+      m_contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+      m_view = std::string_view(m_contents);
+      m_valid = !file.bad();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+      if (m_mapped)
+      {
+        munmap(m_mapped, m_view.size());
+      }
+#endif
+    }
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    inline bool isValid() const
+    {
+      return m_valid;
+    }
+
+    inline std::string_view view() const
+    {
+      return m_view;
+    }
+
+  protected:
+    bool m_valid = false;
+    std::string_view m_view;
+#ifndef _WIN32
+    void *m_mapped = nullptr;
+#else
+    std::string m_contents;
+#endif
+  };
+
+  /** A class or alias as written, with every identifier in its base list or aliased type */
+  struct WrittenDeclaration
+  {
+    std::string name;
+    std::vector<std::string> bases;
+  };
+
+  inline bool isIdentifierChar(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+  }
+
+  /** Minimal tokenizer, only tells identifiers apart from punctuation and skips whitespace and comments */
+  class TokenReader
+  {
+  public:
+    TokenReader(std::string_view text, size_t position)
+        : m_text(text), m_position(position)
+    {
+    }
+
+    /** Reads the next token, identifiers whole and everything else one character at a time ("::" as one) */
+    bool next(std::string_view &outToken)
+    {
+      skipSpace();
+      if (m_position >= m_text.size())
+      {
+        return false;
+      }
+
+      size_t start = m_position;
+      if (isIdentifierChar(m_text[m_position]))
+      {
+        while (m_position < m_text.size() && isIdentifierChar(m_text[m_position]))
+        {
+          m_position++;
+        }
+      }
+      else if (m_text.compare(m_position, 2, "::") == 0)
+      {
+        m_position += 2;
+      }
+      else
+      {
+        m_position++;
+      }
+
+      outToken = m_text.substr(start, m_position - start);
+      return true;
+    }
+
+  protected:
+    void skipSpace()
+    {
+      while (m_position < m_text.size())
+      {
+        char c = m_text[m_position];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v' || c == '\\')
+        {
+          m_position++;
+        }
+        else if (m_text.compare(m_position, 2, "//") == 0)
+        {
+          size_t end = m_text.find('\n', m_position);
+          m_position = end == std::string_view::npos ? m_text.size() : end;
+        }
+        else if (m_text.compare(m_position, 2, "/*") == 0)
+        {
+          size_t end = m_text.find("*/", m_position + 2);
+          m_position = end == std::string_view::npos ? m_text.size() : end + 2;
+        }
+        else
+        {
+          break;
+        }
+      }
+    }
+
+    std::string_view m_text;
+    size_t m_position = 0;
+  };
+
+  inline bool isIdentifier(std::string_view token)
+  {
+    return !token.empty() && isIdentifierChar(token[0]) && !(token[0] >= '0' && token[0] <= '9');
+  }
+
+  inline bool isBaseKeyword(std::string_view token)
+  {
+    return token == "public" || token == "protected" || token == "private" || token == "virtual" || token == "typename" || token == "template";
+  }
+
+  /** Reads "class|struct [attributes] Name [final] : bases {" following the keyword */
+  bool readClass(TokenReader &reader, WrittenDeclaration &outDeclaration)
+  {
+    std::string_view token;
+    int32_t depth = 0;
+    while (reader.next(token))
+    {
+      // Attributes, alignas, export macros with arguments and template arguments of specializations
+      if (token == "(" || token == "[" || token == "<")
+      {
+        depth++;
+        continue;
+      }
+      if (token == ")" || token == "]" || token == ">")
+      {
+        if (--depth < 0)
+        {
+          return false;
+        }
+        continue;
+      }
+      if (depth > 0)
+      {
+        continue;
+      }
+
+      if (token == ":")
+      {
+        break;
+      }
+      if (!isIdentifier(token))
+      {
+        return false;
+      }
+      if (token != "final")
+      {
+        outDeclaration.name = std::string(token);
+      }
+    }
+
+    if (outDeclaration.name.empty())
+    {
+      return false;
+    }
+
+    while (reader.next(token) && token != "{" && token != ";")
+    {
+      if (isIdentifier(token) && !isBaseKeyword(token))
+      {
+        outDeclaration.bases.push_back(std::string(token));
+      }
+    }
+
+    return !outDeclaration.bases.empty();
+  }
+
+  /** Reads "using Name = type;" following the keyword */
+  bool readUsing(TokenReader &reader, WrittenDeclaration &outDeclaration)
+  {
+    std::string_view token;
+    if (!reader.next(token) || !isIdentifier(token) || token == "namespace")
+    {
+      return false;
+    }
+    outDeclaration.name = std::string(token);
+
+    if (!reader.next(token) || token != "=")
+    {
+      return false;
+    }
+
+    while (reader.next(token) && token != ";")
+    {
+      if (isIdentifier(token))
+      {
+        outDeclaration.bases.push_back(std::string(token));
+      }
+    }
+
+    return !outDeclaration.bases.empty();
+  }
+
+  /** Reads "typedef type Name;" following the keyword */
+  bool readTypedef(TokenReader &reader, WrittenDeclaration &outDeclaration)
+  {
+    std::string_view token;
+    std::vector<std::string> identifiers;
+    while (reader.next(token) && token != ";" && token != "{" && token != "(")
+    {
+      if (isIdentifier(token))
+      {
+        identifiers.push_back(std::string(token));
+      }
+    }
+
+    if (identifiers.size() < 2)
+    {
+      return false;
+    }
+
+    outDeclaration.name = identifiers.back();
+    identifiers.pop_back();
+    outDeclaration.bases = identifiers;
+    return true;
+  }
+
+  /**
+   * Finds the class and alias declarations with a base list or aliased type. The keywords are located with plain
+   * substring searches, so the bulk of the text is skipped by memchr instead of being tokenized.
+   */
+  std::vector<WrittenDeclaration> scanDeclarations(std::string_view text)
+  {
+    std::vector<WrittenDeclaration> declarations;
+
+    for (std::string_view keyword : {std::string_view("class"), std::string_view("struct"), std::string_view("using"), std::string_view("typedef")})
+    {
+      size_t position = text.find(keyword);
+      while (position != std::string_view::npos)
+      {
+        size_t end = position + keyword.size();
+        bool wholeWord = (position == 0 || !isIdentifierChar(text[position - 1])) && (end >= text.size() || !isIdentifierChar(text[end]));
+        if (wholeWord)
+        {
+          TokenReader reader(text, end);
+          WrittenDeclaration declaration;
+          bool found = false;
+          if (keyword == "using")
+          {
+            found = readUsing(reader, declaration);
+          }
+          else if (keyword == "typedef")
+          {
+            found = readTypedef(reader, declaration);
+          }
+          else
+          {
+            found = readClass(reader, declaration);
+          }
+
+          if (found)
+          {
+            declarations.push_back(declaration);
+          }
+        }
+
+        position = text.find(keyword, end);
+      }
+    }
+
+    return declarations;
+  }
+
+  /** The unqualified name of a class, without template arguments */
+  std::string getShortName(std::string const &className)
+  {
+    std::string name = className.substr(0, className.find('<'));
+    size_t separator = name.rfind("::");
+    return separator == std::string::npos ? name : name.substr(separator + 2);
+  }
+}
+
+bool ReflectionIndex::load(std::string const &path)
+{
+  ReflectionIndex loaded;
+  if (!readSerializable(path, loaded))
+  {
+    return false;
+  }
+
+  *this = loaded;
+  return true;
+}
+
+bool ReflectionIndex::save(std::string const &path) const
+{
+  return writeSerializable(path, *this);
+}
+
+void ReflectionIndex::learnFrom(HeaderFile const &header)
+{
+  std::set<std::string> ownClasses;
+  for (auto const &classDecl : header.getClassDeclarations())
+  {
+    ownClasses.insert(classDecl.getFullyQualifiedName());
+  }
+
+  std::set<std::string> &headerClasses = m_headerClasses[header.getFilePath()];
+  headerClasses.clear();
+  for (auto const &edge : header.getInheritMap())
+  {
+    if (!header.doesClassInherit(edge.first, "wir::Class"))
+    {
+      continue;
+    }
+
+    if (ownClasses.find(edge.first) != ownClasses.end())
+    {
+      headerClasses.insert(getShortName(edge.first));
+    }
+    else
+    {
+      m_externalClasses.insert(getShortName(edge.first));
+    }
+  }
+}
+
+void ReflectionIndex::learnSkipped(std::string const &headerPath)
+{
+  m_headerClasses[headerPath].clear();
+}
+
+void ReflectionIndex::prune(std::set<std::string> const &existingHeaders)
+{
+  for (auto it = m_headerClasses.begin(); it != m_headerClasses.end();)
+  {
+    if (existingHeaders.find(it->first) == existingHeaders.end())
+    {
+      it = m_headerClasses.erase(it);
+    }
+    else
+    {
+      it++;
+    }
+  }
+}
+
+std::set<std::string> ReflectionIndex::getClassNames() const
+{
+  std::set<std::string> names = m_externalClasses;
+  names.insert("Class");
+  for (auto const &header : m_headerClasses)
+  {
+    names.insert(header.second.begin(), header.second.end());
+  }
+
+  return names;
+}
+
+uint64_t ReflectionIndex::getHash() const
+{
+  std::set<std::string> names = getClassNames();
+  return hashStrings(std::vector<std::string>(names.begin(), names.end()));
+}
+
+std::set<std::string> ReflectionIndex::scan(std::vector<std::string> const &headerPaths) const
+{
+  std::set<std::string> matched;
+  std::map<std::string, std::vector<WrittenDeclaration>> declarations;
+  for (auto const &headerPath : headerPaths)
+  {
+    MappedFile file(headerPath);
+    if (!file.isValid())
+    {
+      // Leave it to the parser to report
+      matched.insert(headerPath);
+      continue;
+    }
+
+    declarations[headerPath] = scanDeclarations(file.view());
+  }
+
+  // Classes found to match become known in turn, until nothing new turns up
+  std::set<std::string> names = getClassNames();
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto const &header : declarations)
+    {
+      for (auto const &declaration : header.second)
+      {
+        bool matches = false;
+        for (auto const &base : declaration.bases)
+        {
+          if (names.find(base) != names.end())
+          {
+            matches = true;
+            break;
+          }
+        }
+
+        if (!matches)
+        {
+          continue;
+        }
+
+        matched.insert(header.first);
+        if (names.insert(declaration.name).second)
+        {
+          changed = true;
+        }
+      }
+    }
+  }
+
+  return matched;
+}
+
+bool ReflectionIndex::serialize(wir::Stream &toStream) const
+{
+  toStream << reflectionIndexFormatVersion;
+
+  toStream << (uint64_t)m_headerClasses.size();
+  for (auto const &header : m_headerClasses)
+  {
+    toStream << header.first;
+    toStream << (uint64_t)header.second.size();
+    for (auto const &name : header.second)
+    {
+      toStream << name;
+    }
+  }
+
+  toStream << (uint64_t)m_externalClasses.size();
+  for (auto const &name : m_externalClasses)
+  {
+    toStream << name;
+  }
+
+  return true;
+}
+
+bool ReflectionIndex::deserialize(wir::Stream &fromStream)
+{
+  m_headerClasses.clear();
+  m_externalClasses.clear();
+
+  uint32_t version = 0;
+  fromStream >> version;
+  if (version != reflectionIndexFormatVersion)
+  {
+    return false;
+  }
+
+  uint64_t numHeaders = 0;
+  fromStream >> numHeaders;
+  for (uint64_t i = 0; i < numHeaders; i++)
+  {
+    std::string headerPath;
+    fromStream >> headerPath;
+
+    std::set<std::string> &names = m_headerClasses[headerPath];
+    uint64_t numNames = 0;
+    fromStream >> numNames;
+    for (uint64_t j = 0; j < numNames; j++)
+    {
+      std::string name;
+      fromStream >> name;
+      names.insert(name);
+    }
+  }
+
+  uint64_t numExternal = 0;
+  fromStream >> numExternal;
+  for (uint64_t i = 0; i < numExternal; i++)
+  {
+    std::string name;
+    fromStream >> name;
+    m_externalClasses.insert(name);
+  }
+
+  return true;
+}
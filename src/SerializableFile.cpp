@@ -0,0 +1,162 @@
+#include "SerializableFile.hpp"
+
+#include <WIR/Filesystem.hpp>
+#include <WIR/String.hpp>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+namespace
+{
+  // Temporary names must not collide between threads nor between processes sharing a cache
+  uint64_t const tempFileNonce = (uint64_t(std::random_device()()) << 32) | std::random_device()();
+  std::atomic_uint64_t tempFileCounter{0};
+
+  // Size of the buffer this thread is deserializing, every element takes at least a byte of it
+  thread_local uint64_t deserializeBound = UINT64_MAX;
+}
+
+bool serializeToBytes(wir::Serializable const &object, std::vector<uint8_t> &outBytes)
+{
+  wir::MemoryStream stream;
+  if (!object.serialize(stream))
+  {
+    return false;
+  }
+
+  outBytes = stream.data();
+  return true;
+}
+
+bool deserializeFromBytes(std::vector<uint8_t> const &bytes, wir::Serializable &object)
+{
+  struct BoundScope
+  {
+    BoundScope(uint64_t bound)
+        : previous(deserializeBound)
+    {
+      deserializeBound = bound;
+    }
+
+    ~BoundScope()
+    {
+      deserializeBound = previous;
+    }
+
+    uint64_t previous;
+  } boundScope(bytes.size());
+
+  // Caches and results written by other processes can be truncated or garbled, reading one is never fatal
+  try
+  {
+    wir::MemoryStream stream(bytes);
+    return object.deserialize(stream);
+  }
+  catch (std::exception &)
+  {
+    return false;
+  }
+}
+
+void checkCount(uint64_t count)
+{
+  if (count > deserializeBound)
+  {
+    throw std::length_error(wir::format("Corrupt stream, %llu elements in %llu bytes", (unsigned long long)count, (unsigned long long)deserializeBound));
+  }
+}
+
+std::string makeTempPath(std::string const &path)
+{
+  return wir::format("%s.%016llx.%llu.tmp", path.c_str(), (unsigned long long)tempFileNonce, (unsigned long long)tempFileCounter.fetch_add(1));
+}
+
+bool writeFileAtomic(std::string const &path, void const *data, uint64_t size, bool createPath)
+{
+  if (createPath)
+  {
+    wir::File(path).createPath();
+  }
+
+  std::string tempPath = makeTempPath(path);
+  {
+    std::ofstream file(tempPath, std::ios_base::binary | std::ios_base::trunc);
+    if (!file.is_open())
+    {
+      return false;
+    }
+
+    file.write((char const *)data, size);
+    if (!file)
+    {
+      file.close();
+      std::error_code error;
+      std::filesystem::remove(tempPath, error);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if (error)
+  {
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+
+  return true;
+}
+
+bool writeFileIfChanged(std::string const &path, std::string_view content, bool &outChanged, bool createPath)
+{
+  outChanged = true;
+
+  // Only a file of the same size can be identical, anything else is rewritten without reading it
+  std::error_code error;
+  uint64_t existingSize = std::filesystem::file_size(path, error);
+  if (!error && existingSize == content.size())
+  {
+    std::ifstream file(path, std::ios_base::binary);
+    std::string existing(content.size(), '\0');
+    if (file.is_open() && file.read(existing.data(), existing.size()) && existing == content)
+    {
+      outChanged = false;
+      return true;
+    }
+  }
+
+  return writeFileAtomic(path, content.data(), content.size(), createPath);
+}
+
+bool writeSerializable(std::string const &path, wir::Serializable const &object)
+{
+  std::vector<uint8_t> bytes;
+  if (!serializeToBytes(object, bytes))
+  {
+    return false;
+  }
+
+  return writeFileAtomic(path, bytes.data(), bytes.size());
+}
+
+bool readSerializable(std::string const &path, wir::Serializable &object)
+{
+  std::ifstream file(path, std::ios_base::binary);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (bytes.empty())
+  {
+    return false;
+  }
+
+  return deserializeFromBytes(bytes, object);
+}
@@ -0,0 +1,205 @@
+#include "ShardResult.hpp"
+
+#include "ContentHash.hpp"
+#include "SerializableFile.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  // Bump whenever the serialized layout changes, this includes the layout of HeaderFile
+  uint32_t const shardFormatVersion = 4;
+
+  std::string resolvePath(std::string const &path, std::string const &rootPath)
+  {
+    return !path.empty() && path[0] == '/' ? path : rootPath + "/" + path;
+  }
+}
+
+void ShardEntry::makePathsRelative(std::string const &rootPath)
+{
+  std::string prefix = rootPath + "/";
+  if (inputFile.compare(0, prefix.size(), prefix) == 0)
+  {
+    inputFile.erase(0, prefix.size());
+  }
+
+  header.makePathsRelative(rootPath);
+}
+
+void ShardEntry::makePathsAbsolute(std::string const &rootPath)
+{
+  inputFile = resolvePath(inputFile, rootPath);
+  header.makePathsAbsolute(rootPath);
+}
+
+bool ShardEntry::recordHashes(std::string const &rootPath, FileHashCache &hashes)
+{
+  includeHashes.clear();
+  if (!hashes.getHash(resolvePath(inputFile, rootPath), headerHash))
+  {
+    return false;
+  }
+
+  for (auto const &include : header.getIncludes())
+  {
+    uint64_t includeHash = 0;
+    if (!hashes.getHash(resolvePath(include, rootPath), includeHash))
+    {
+      return false;
+    }
+
+    includeHashes.push_back(includeHash);
+  }
+
+  return true;
+}
+
+bool ShardEntry::matchesHashes(std::string const &rootPath, FileHashCache &hashes) const
+{
+  uint64_t currentHash = 0;
+  if (!hashes.getHash(resolvePath(inputFile, rootPath), currentHash) || currentHash != headerHash)
+  {
+    return false;
+  }
+
+  auto const &includes = header.getIncludes();
+  if (includes.size() != includeHashes.size())
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < includes.size(); i++)
+  {
+    if (!hashes.getHash(resolvePath(includes[i], rootPath), currentHash) || currentHash != includeHashes[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ShardResult::load(std::string const &path)
+{
+  return readSerializable(path, *this);
+}
+
+bool ShardResult::save(std::string const &path) const
+{
+  return writeSerializable(path, *this);
+}
+
+uint64_t ShardResult::computeOptionsHash(std::vector<std::string> const &cxxFlagsExtra, ParseOptions const &options)
+{
+  // The parser version is left out, hosts are not expected to have the exact same libclang build
+  return hashStrings(HeaderFile::getCompilerFlags(cxxFlagsExtra), hashString(options.getKey()));
+}
+
+bool ShardResult::serialize(wir::Stream &toStream) const
+{
+  toStream << shardFormatVersion;
+  toStream << optionsHash;
+  toStream << shardIndex;
+  toStream << numShards;
+
+  toStream << (uint64_t)entries.size();
+  for (auto const &entry : entries)
+  {
+    toStream << entry.inputFile;
+    toStream << entry.duration;
+    toStream << entry.headerHash;
+    toStream << (uint64_t)entry.includeHashes.size();
+    for (auto const &includeHash : entry.includeHashes)
+    {
+      toStream << includeHash;
+    }
+    toStream << entry.header;
+  }
+
+  return true;
+}
+
+bool ShardResult::deserialize(wir::Stream &fromStream)
+{
+  entries.clear();
+
+  uint32_t version = 0;
+  fromStream >> version;
+  if (version != shardFormatVersion)
+  {
+    return false;
+  }
+
+  fromStream >> optionsHash;
+  fromStream >> shardIndex;
+  fromStream >> numShards;
+
+  uint64_t numEntries = 0;
+  fromStream >> numEntries;
+  for (uint64_t i = 0; i < numEntries; i++)
+  {
+    ShardEntry &entry = entries.emplace_back();
+    entry.header = HeaderFile(symbols);
+    fromStream >> entry.inputFile;
+    fromStream >> entry.duration;
+    fromStream >> entry.headerHash;
+
+    uint64_t numHashes = 0;
+    fromStream >> numHashes;
+    for (uint64_t j = 0; j < numHashes; j++)
+    {
+      uint64_t newHash = 0;
+      fromStream >> newHash;
+      entry.includeHashes.push_back(newHash);
+    }
+
+    fromStream >> entry.header;
+  }
+
+  return true;
+}
+
+std::vector<std::string> selectShardHeaders(std::vector<std::string> const &headers, std::string const &rootPath, uint32_t shardIndex, uint32_t numShards, FileHashCache &hashes)
+{
+  struct WeightedHeader
+  {
+    std::string const *path;
+    std::string relativePath;
+    uint64_t size = 0;
+  };
+
+  std::vector<WeightedHeader> weighted;
+  for (auto const &header : headers)
+  {
+    WeightedHeader &newHeader = weighted.emplace_back();
+    newHeader.path = &header;
+    newHeader.relativePath = header.compare(0, rootPath.size(), rootPath) == 0 ? header.substr(rootPath.size()) : header;
+
+    // Unreadable headers weigh nothing, they fail the same way wherever they end up
+    FileRecord record;
+    if (hashes.getRecord(header, record))
+    {
+      newHeader.size = record.size;
+    }
+  }
+
+  std::sort(weighted.begin(), weighted.end(), [](WeightedHeader const &a, WeightedHeader const &b) {
+    return a.size != b.size ? a.size > b.size : a.relativePath < b.relativePath;
+  });
+
+  std::vector<uint64_t> shardSizes(numShards, 0);
+  std::vector<std::string> selected;
+  for (auto const &header : weighted)
+  {
+    uint32_t lightest = uint32_t(std::min_element(shardSizes.begin(), shardSizes.end()) - shardSizes.begin());
+    shardSizes[lightest] += std::max<uint64_t>(header.size, 1);
+    if (lightest == shardIndex)
+    {
+      selected.push_back(*header.path);
+    }
+  }
+
+  std::sort(selected.begin(), selected.end());
+  return selected;
+}
@@ -0,0 +1,110 @@
+#include "WorkStealingPool.hpp"
+
+WorkStealingPool::WorkStealingPool(uint32_t numWorkers)
+{
+  if (numWorkers < 1)
+  {
+    numWorkers = 1;
+  }
+
+  for (uint32_t i = 0; i < numWorkers; i++)
+  {
+    m_queues.push_back(std::make_unique<WorkerQueue>());
+  }
+
+  for (uint32_t i = 0; i < numWorkers; i++)
+  {
+    m_threads.emplace_back([this, i]() { workerLoop(i); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::scoped_lock lock(m_sleepMutex);
+    m_stopping.store(true);
+  }
+  m_sleepCondition.notify_all();
+
+  for (auto &thread : m_threads)
+  {
+    thread.join();
+  }
+}
+
+uint32_t WorkStealingPool::getDefaultNumWorkers()
+{
+  int32_t numWorkers = int32_t(std::thread::hardware_concurrency()) - 2;
+  return numWorkers < 1 ? 1 : uint32_t(numWorkers);
+}
+
+void WorkStealingPool::submit(Job job)
+{
+  uint64_t index = m_nextQueue.fetch_add(1) % m_queues.size();
+  {
+    WorkerQueue &queue = *m_queues[index];
+    std::scoped_lock lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+    m_queuedJobs.fetch_add(1);
+  }
+
+  // Pass through the sleep mutex so a worker between its check and its sleep cannot miss the wakeup
+  {
+    std::scoped_lock lock(m_sleepMutex);
+  }
+  m_sleepCondition.notify_one();
+}
+
+bool WorkStealingPool::popJob(uint32_t index, Job &outJob)
+{
+  // Own queue first, then every other queue starting from the next neighbour.
+  // Queues are drained from the front in both cases, so jobs run in roughly the order they were submitted.
+  uint32_t numQueues = (uint32_t)m_queues.size();
+  for (uint32_t offset = 0; offset < numQueues; offset++)
+  {
+    WorkerQueue &queue = *m_queues[(index + offset) % numQueues];
+    std::unique_lock lock(queue.mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+      // Someone else is working this queue, only block on it if it is our own
+      if (offset != 0)
+      {
+        continue;
+      }
+      lock.lock();
+    }
+
+    if (queue.jobs.empty())
+    {
+      continue;
+    }
+
+    outJob = std::move(queue.jobs.front());
+    queue.jobs.pop_front();
+    m_queuedJobs.fetch_sub(1);
+    return true;
+  }
+
+  return false;
+}
+
+void WorkStealingPool::workerLoop(uint32_t index)
+{
+  while (true)
+  {
+    Job job;
+    if (popJob(index, job))
+    {
+      job();
+      continue;
+    }
+
+    std::unique_lock lock(m_sleepMutex);
+    if (m_stopping.load() && m_queuedJobs.load() == 0)
+    {
+      return;
+    }
+
+    m_sleepCondition.wait(lock, [this]() { return m_queuedJobs.load() > 0 || m_stopping.load(); });
+  }
+}
@@ -0,0 +1,117 @@
+#!/bin/sh
+# Runs the generator over a generated corpus of a few thousand headers with LeakSanitizer enabled, and fails on any
+# leak or memory error it reports. Every run mode that owns libclang handles is covered: visitor and indexer parses,
+# single file parses reading tokens, harvesting, the precompiled preamble and warm parse cache loads.
+#
+#   test/leakcheck.sh <generator built with SANITIZE=address> [number of headers]
+#
+# Leaks inside libclang itself can be suppressed through LSAN_OPTIONS=suppressions=<file>, which is passed through.
+
+set -u
+
+GENERATOR=${1:?usage: leakcheck.sh <generator> [number of headers]}
+NUM_HEADERS=${2:-3000}
+
+WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/wircodegen-leakcheck.XXXXXX")
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# A stand-in for wir::Class, so the corpus does not need the framework installed
+mkdir -p "$WORKDIR/framework/WIR" "$WORKDIR/corpus"
+cat > "$WORKDIR/framework/WIR/Class.hpp" <<'HEADER'
+#pragma once
+namespace wir
+{
+  class DynamicArguments;
+  class Class
+  {
+  public:
+    virtual ~Class() = default;
+  };
+}
+HEADER
+
+# Headers spread over directories and namespaces, in chains of 20 where each derives from classes of the one before
+# it, with annotated methods and enums. Every 50th header also gets a broken neighbour nothing includes, so failed parses
+# and their diagnostics are covered as well.
+i=0
+while [ "$i" -lt "$NUM_HEADERS" ]; do
+  module=$((i % 40))
+  previous=$((i - 1))
+  mkdir -p "$WORKDIR/corpus/module$module"
+  {
+    echo "#pragma once"
+    echo "#include <WIR/Class.hpp>"
+    if [ $((i % 20)) -ne 0 ]; then
+      echo "#include \"../module$((previous % 40))/Header$previous.hpp\""
+    fi
+    echo "namespace corpus { namespace module$module {"
+    echo "enum class State$i { Idle, Running$i, Stopped };"
+    echo "class __attribute__((annotate(\"Reflect\"))) Component$i : public wir::Class"
+    echo "{"
+    echo "public:"
+    echo "  Component$i(wir::DynamicArguments const &args);"
+    echo "  __attribute__((annotate(\"Reflect\"))) void update$i(float delta);"
+    echo "  virtual int computeValue() const;"
+    echo "protected:"
+    echo "  State$i m_state = State$i::Idle;"
+    echo "};"
+    if [ $((i % 20)) -ne 0 ]; then
+      echo "class Derived$i : public corpus::module$((previous % 40))::Component$previous"
+    else
+      echo "class Derived$i : public Component$i"
+    fi
+    echo "{"
+    echo "public:"
+    echo "  Derived$i(wir::DynamicArguments const &args);"
+    echo "  virtual int computeValue() const override = 0;"
+    echo "};"
+    echo "} }"
+  } > "$WORKDIR/corpus/module$module/Header$i.hpp"
+
+  if [ $((i % 50)) -eq 49 ]; then
+    {
+      echo "#include <WIR/Class.hpp>"
+      echo "class Broken$i : public UndeclaredBase$i {"
+    } > "$WORKDIR/corpus/module$module/Broken$i.hpp"
+  fi
+
+  i=$((i + 1))
+done
+
+LSAN_OPTIONS="${LSAN_OPTIONS:+$LSAN_OPTIONS:}detect_leaks=1"
+ASAN_OPTIONS="${ASAN_OPTIONS:+$ASAN_OPTIONS:}detect_leaks=1:halt_on_error=1"
+export LSAN_OPTIONS ASAN_OPTIONS
+
+failures=0
+run()
+{
+  name=$1
+  shift
+  log="$WORKDIR/$name.log"
+  echo "leakcheck: $name"
+  "$GENERATOR" --inputPath="$WORKDIR/corpus" --outputPath="$WORKDIR/out-$name" --include="$WORKDIR/framework" "$@" > "$log" 2>&1
+  status=$?
+
+  # Broken headers make the generator report errors, but never exit because of them, so any failure is the sanitizer
+  if [ "$status" -ne 0 ] || grep -q "Sanitizer" "$log"; then
+    echo "leakcheck: $name failed (exit status $status)"
+    grep -A 40 "Sanitizer" "$log" | head -n 200
+    failures=$((failures + 1))
+  fi
+}
+
+# The second run finds its outputs missing, but every parse in the cache the first one left behind
+run visitor --engine=visitor --cachePath="$WORKDIR/cache"
+run cached --engine=visitor --cachePath="$WORKDIR/cache"
+run indexer --engine=indexer --noCache
+run single-file --singleFile --noCache
+run harvest --harvest --noCache
+run preamble --pch --noCache
+run full-profile --parseProfile=full --noCache
+
+if [ "$failures" -ne 0 ]; then
+  echo "leakcheck: $failures of 7 runs reported leaks or memory errors"
+  exit 1
+fi
+
+echo "leakcheck: no leaks in 7 runs over $NUM_HEADERS headers"